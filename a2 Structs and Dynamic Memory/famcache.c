@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "famcache.h"
+
+
+/* Return a pointer to a new, empty cache whose entries may use at most
+   cap bytes of memory.
+*/
+FamCache *new_famcache(size_t cap) {
+    FamCache *cache = calloc(1, sizeof(struct famcache));
+    if(cache==NULL){
+        perror("calloc");
+        exit(1);
+    }
+    cache->cap = cap;
+    return cache;
+}
+
+
+/* Return the bucket for words of length len after the guesses history. */
+static int bucket_of(int len, char *history) {
+    unsigned int h = 2166136261u ^ len;
+    while (*history) {
+        h = (h ^ (unsigned char) *history) * 16777619u;
+        history++;
+    }
+    return h % FAMCACHE_BUCKETS;
+}
+
+
+/* Take entry out of the recently-used list of cache. */
+static void unlink_entry(FamCache *cache, struct cache_entry *entry) {
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        cache->newest = entry->older;
+    }
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        cache->oldest = entry->newer;
+    }
+    entry->newer = NULL;
+    entry->older = NULL;
+}
+
+
+/* Make entry the most recently used entry of cache. */
+static void make_newest(FamCache *cache, struct cache_entry *entry) {
+    entry->older = cache->newest;
+    entry->newer = NULL;
+    if (cache->newest) {
+        cache->newest->newer = entry;
+    } else {
+        cache->oldest = entry;
+    }
+    cache->newest = entry;
+}
+
+
+/* Remove the least recently used entry of cache and free it. */
+static void evict_oldest(FamCache *cache) {
+    struct cache_entry *entry = cache->oldest;
+    struct cache_entry **p = &cache->buckets[bucket_of(entry->len, entry->history)];
+
+    while (*p != entry) {
+        p = &(*p)->next_in_bucket;
+    }
+    *p = entry->next_in_bucket;
+    unlink_entry(cache, entry);
+    cache->used -= entry->size;
+    cache->evictions++;
+    free(entry->history);
+    free(entry->signature);
+    free(entry->word_ptrs);
+    free(entry);
+}
+
+
+/* Return the entry for words of length len after the guesses history,
+   or NULL if there is none. Counts a hit or a miss.
+*/
+struct cache_entry *famcache_find(FamCache *cache, int len, char *history) {
+    struct cache_entry *entry = cache->buckets[bucket_of(len, history)];
+
+    while (entry && (entry->len != len || strcmp(entry->history, history) != 0)) {
+        entry = entry->next_in_bucket;
+    }
+    if (entry == NULL) {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
+    unlink_entry(cache, entry);
+    make_newest(cache, entry);
+    return entry;
+}
+
+
+/* Add an entry saying that after the guesses history, the family chosen
+   for words of length len has the given signature and num_words words.
+   The signature and word pointers are copied; the words are not.
+   Least recently used entries are removed to make room. An entry
+   bigger than the whole cap is not added.
+*/
+void famcache_add(FamCache *cache, int len, char *history,
+                  char *signature, char **word_ptrs, int num_words) {
+    struct cache_entry *entry;
+    int b;
+    size_t size = sizeof(struct cache_entry) + strlen(history) + 1 +
+                  strlen(signature) + 1 + (num_words + 1) * sizeof(char *);
+
+    if (size > cache->cap) {
+        return;
+    }
+    while (cache->used + size > cache->cap) {
+        evict_oldest(cache);
+    }
+
+    entry = malloc(sizeof(struct cache_entry));
+    if(entry==NULL){
+        perror("malloc");
+        exit(1);
+    }
+    entry->history = malloc(strlen(history) + 1);
+    entry->signature = malloc(strlen(signature) + 1);
+    entry->word_ptrs = malloc((num_words + 1) * sizeof(char *));
+    if(entry->history==NULL || entry->signature==NULL || entry->word_ptrs==NULL){
+        perror("malloc");
+        exit(1);
+    }
+    strcpy(entry->history, history);
+    strcpy(entry->signature, signature);
+    memcpy(entry->word_ptrs, word_ptrs, num_words * sizeof(char *));
+    entry->word_ptrs[num_words] = NULL;
+    entry->len = len;
+    entry->num_words = num_words;
+    entry->size = size;
+
+    b = bucket_of(len, history);
+    entry->next_in_bucket = cache->buckets[b];
+    cache->buckets[b] = entry;
+    make_newest(cache, entry);
+    cache->used += size;
+}
+
+
+/* Print the hit, miss and eviction counters of cache to fp. */
+void print_famcache_stats(FamCache *cache, FILE *fp) {
+    fprintf(fp, "Family cache: %ld hits, %ld misses, %ld evictions, %zu bytes used\n",
+            cache->hits, cache->misses, cache->evictions, cache->used);
+}
+
+
+/* Deallocate all memory acquired by the cache. */
+void deallocate_famcache(FamCache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    while (cache->oldest) {
+        evict_oldest(cache);
+    }
+    free(cache);
+}
@@ -0,0 +1,47 @@
+#ifndef FAMCACHE_H
+#define FAMCACHE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* Number of hash buckets in a family cache. */
+#define FAMCACHE_BUCKETS 4096
+
+/* The family the adversary chose after one sequence of guesses. */
+struct cache_entry {
+    int len; /* Length of the words */
+    char *history; /* The guesses so far, in order */
+    char *signature; /* Signature of the chosen family */
+    char **word_ptrs; /* Words of the chosen family; NULL-terminated */
+    int num_words; /* Number of words in word_ptrs */
+    size_t size; /* Bytes of memory used by this entry */
+    struct cache_entry *next_in_bucket; /* NULL means end of bucket */
+    struct cache_entry *newer; /* Entry used next after this one, or NULL */
+    struct cache_entry *older; /* Entry used last before this one, or NULL */
+};
+
+/* A cache of the adversary's choices, keyed by word length and guess
+   history. When the memory used goes over the cap, the least recently
+   used entries are removed.
+*/
+struct famcache {
+    struct cache_entry *buckets[FAMCACHE_BUCKETS];
+    struct cache_entry *newest; /* Most recently used entry */
+    struct cache_entry *oldest; /* Least recently used entry */
+    size_t used; /* Bytes of memory used by all entries */
+    size_t cap; /* Most bytes of memory the entries may use */
+    long hits; /* Number of famcache_find calls that found an entry */
+    long misses; /* Number of famcache_find calls that did not */
+    long evictions; /* Number of entries removed to stay under cap */
+};
+typedef struct famcache FamCache;
+
+
+FamCache *new_famcache(size_t cap);
+struct cache_entry *famcache_find(FamCache *cache, int len, char *history);
+void famcache_add(FamCache *cache, int len, char *history,
+                  char *signature, char **word_ptrs, int num_words);
+void print_famcache_stats(FamCache *cache, FILE *fp);
+void deallocate_famcache(FamCache *cache);
+
+#endif
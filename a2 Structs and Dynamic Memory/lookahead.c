@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "lookahead.h"
+#include "reading.h"
+
+
+/* Return a pointer to a new Lookahead for word lists of up to max_words
+   words, searching depth guesses ahead within budget_msec per choice.
+*/
+Lookahead *new_lookahead(int max_words, int depth, int budget_msec) {
+    Lookahead *la = malloc(sizeof(struct lookahead));
+    if(la==NULL){
+        perror("malloc");
+        exit(1);
+    }
+    la->depth = depth;
+    la->budget_nsec = budget_msec * 1000000L;
+    la->max_words = max_words;
+    la->letter_masks = malloc((size_t) max_words * 26 * sizeof(uint64_t));
+    la->keys = malloc((size_t) max_words * sizeof(uint64_t));
+    la->arena = malloc((size_t) (depth + 1) * max_words * sizeof(struct lkpair));
+    la->tt = calloc(LOOKAHEAD_TT_SIZE, sizeof(struct ttentry));
+    if(la->letter_masks==NULL || la->keys==NULL ||
+       la->arena==NULL || la->tt==NULL){
+        perror("malloc");
+        exit(1);
+    }
+    la->timed_out = 0;
+    la->nodes = 0;
+    return la;
+}
+
+
+/* Return a well-mixed 64-bit value for x (splitmix64 finalizer). */
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+
+/* Sort pairs by family, keeping word order within a family. */
+static int compare_pairs(const void *p1, const void *p2) {
+    const struct lkpair *a = p1;
+    const struct lkpair *b = p2;
+
+    if (a->mask != b->mask) {
+        return a->mask < b->mask ? -1 : 1;
+    }
+    return a->idx - b->idx;
+}
+
+
+/* Set la->timed_out if the deadline has passed. */
+static void check_deadline(Lookahead *la) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > la->deadline.tv_sec ||
+        (now.tv_sec == la->deadline.tv_sec &&
+         now.tv_nsec >= la->deadline.tv_nsec)) {
+        la->timed_out = 1;
+    }
+}
+
+
+/* Return the transposition table slot for a position. */
+static struct ttentry *tt_slot(Lookahead *la, uint64_t fingerprint,
+                               uint32_t guessed, int depth) {
+    uint64_t h = mix(fingerprint ^ ((uint64_t) guessed << 8) ^ depth);
+    return &la->tt[h & (LOOKAHEAD_TT_SIZE - 1)];
+}
+
+
+/* Return the number of words of set left after depth more guesses,
+   where the player picks among their LOOKAHEAD_BREADTH likeliest letters
+   the one that leaves the fewest words, and the adversary answers each
+   letter with the family that leaves the most. set holds m words whose
+   fingerprint is fingerprint; guessed has the letters guessed so far.
+*/
+static int search(Lookahead *la, struct lkpair *set, int m,
+                  uint64_t fingerprint, uint32_t guessed, int depth) {
+    int counts[26] = {0};
+    int letters[LOOKAHEAD_BREADTH];
+    int num_letters = 0;
+    int best = INT_MAX;
+    int i, c, k;
+    struct ttentry *entry;
+    struct lkpair *buf;
+
+    if (m <= 1 || depth == 0) {
+        return m;
+    }
+    la->nodes++;
+    check_deadline(la);
+    if (la->timed_out) {
+        return m;
+    }
+    entry = tt_slot(la, fingerprint, guessed, depth);
+    if (entry->depth == depth && entry->fingerprint == fingerprint &&
+        entry->guessed == guessed) {
+        return entry->value;
+    }
+
+    /* The player's likeliest letters are the ones in the most words. */
+    for (i = 0; i < m; i++) {
+        uint64_t *lm = &la->letter_masks[set[i].idx * 26];
+        for (c = 0; c < 26; c++) {
+            if (lm[c] != 0) {
+                counts[c]++;
+            }
+        }
+    }
+    for (k = 0; k < LOOKAHEAD_BREADTH; k++) {
+        int most = -1;
+        for (c = 0; c < 26; c++) {
+            if (!(guessed >> c & 1) && counts[c] > 0 &&
+                (most == -1 || counts[c] > counts[most])) {
+                most = c;
+            }
+        }
+        if (most == -1) {
+            break;
+        }
+        letters[num_letters++] = most;
+        counts[most] = 0;
+    }
+    if (num_letters == 0) {
+        return m;
+    }
+
+    buf = &la->arena[depth * la->max_words];
+    for (k = 0; k < num_letters && !la->timed_out; k++) {
+        int worst = 0;
+        int start = 0;
+
+        c = letters[k];
+        for (i = 0; i < m; i++) {
+            buf[i].idx = set[i].idx;
+            buf[i].mask = la->letter_masks[set[i].idx * 26 + c];
+        }
+        qsort(buf, m, sizeof(struct lkpair), compare_pairs);
+
+        /* The adversary's reply to c is its best family; once that is
+           no better for the player than an earlier letter, stop. */
+        while (start < m && worst < best) {
+            int end = start;
+            uint64_t child = 0;
+            int v;
+            while (end < m && buf[end].mask == buf[start].mask) {
+                child ^= la->keys[buf[end].idx];
+                end++;
+            }
+            v = search(la, buf + start, end - start, child,
+                       guessed | 1u << c, depth - 1);
+            if (v > worst) {
+                worst = v;
+            }
+            start = end;
+        }
+        if (worst < best) {
+            best = worst;
+        }
+    }
+
+    if (!la->timed_out) {
+        entry->fingerprint = fingerprint;
+        entry->guessed = guessed;
+        entry->depth = depth;
+        entry->value = best;
+    }
+    return best;
+}
+
+
+/* Return the mask of the family of nw to keep for the letter of the last
+   narrow_families call. letters_guessed holds the guesses so far,
+   including that letter, as filled in by get_next_guess.
+
+   Searches one more guess ahead at a time until la->depth or the time
+   budget is reached, and uses the deepest search that finished. Ties go
+   to a family that misses the letter, then to the bigger family, and then
+   by the rule of narrow_biggest.
+*/
+uint64_t lookahead_choose(Lookahead *la, Narrow *nw, char *letters_guessed) {
+    int n = nw->num_words;
+    uint32_t guessed = 0;
+    uint64_t best_mask = narrow_biggest(nw);
+    struct lkpair *root = &la->arena[la->depth * la->max_words];
+    int i, j, d;
+
+    for (i = 0; i < 26; i++) {
+        if (letters_guessed[i]) {
+            guessed |= 1u << i;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        uint64_t *lm = &la->letter_masks[i * 26];
+        const uint64_t *dict_masks = word_letter_masks(nw->word_ptrs[i], nw->len);
+        if (dict_masks != NULL) {
+            memcpy(lm, dict_masks, 26 * sizeof(uint64_t));
+        } else {
+            memset(lm, 0, 26 * sizeof(uint64_t));
+            for (j = 0; j < nw->len; j++) {
+                char ch = nw->word_ptrs[i][j];
+                if (ch >= 'a' && ch <= 'z') {
+                    lm[ch - 'a'] |= (uint64_t) 1 << j;
+                }
+            }
+        }
+        /* Keys follow the word, not its index, so that the table
+           stays valid as the word list is narrowed. */
+        la->keys[i] = mix((uint64_t) (uintptr_t) nw->word_ptrs[i]);
+        root[i].mask = nw->masks[i];
+        root[i].idx = i;
+    }
+    qsort(root, n, sizeof(struct lkpair), compare_pairs);
+
+    clock_gettime(CLOCK_MONOTONIC, &la->deadline);
+    la->deadline.tv_nsec += la->budget_nsec;
+    la->deadline.tv_sec += la->deadline.tv_nsec / 1000000000L;
+    la->deadline.tv_nsec %= 1000000000L;
+    la->timed_out = 0;
+
+    for (d = 1; d < la->depth && !la->timed_out; d++) {
+        uint64_t mask = 0;
+        int best = -1, best_size = 0, best_first = 0;
+        int start = 0;
+
+        while (start < n && !la->timed_out) {
+            int end = start;
+            uint64_t fingerprint = 0;
+            int v, better;
+            while (end < n && root[end].mask == root[start].mask) {
+                fingerprint ^= la->keys[root[end].idx];
+                end++;
+            }
+            v = search(la, root + start, end - start, fingerprint, guessed, d);
+            if (v != best) {
+                better = v > best;
+            } else if ((root[start].mask == 0) != (mask == 0)) {
+                better = root[start].mask == 0;
+            } else if (end - start != best_size) {
+                better = end - start > best_size;
+            } else {
+                better = root[start].idx > best_first;
+            }
+            if (better) {
+                best = v;
+                mask = root[start].mask;
+                best_size = end - start;
+                best_first = root[start].idx;
+            }
+            start = end;
+        }
+        if (!la->timed_out) {
+            best_mask = mask;
+        }
+    }
+    return best_mask;
+}
+
+
+/* Deallocate all memory acquired by new_lookahead. */
+void deallocate_lookahead(Lookahead *la) {
+    if (la == NULL) {
+        return;
+    }
+    free(la->letter_masks);
+    free(la->keys);
+    free(la->arena);
+    free(la->tt);
+    free(la);
+}
@@ -0,0 +1,55 @@
+#ifndef LOOKAHEAD_H
+#define LOOKAHEAD_H
+
+#include <stdint.h>
+#include <time.h>
+#include "narrow.h"
+
+/* Number of entries in the transposition table; a power of 2. */
+#define LOOKAHEAD_TT_SIZE (1 << 16)
+
+/* Number of the player's most likely letters tried at each position. */
+#define LOOKAHEAD_BREADTH 4
+
+/* Most guesses worth searching ahead: a round has at most 26. */
+#define LOOKAHEAD_MAX_DEPTH 26
+
+/* A remembered search result. */
+struct ttentry {
+    uint64_t fingerprint; /* Fingerprint of the set of words */
+    uint32_t guessed; /* Bit c is set if letter 'a' + c was guessed */
+    int depth; /* Guesses looked ahead; 0 means the entry is free */
+    int value; /* Words left after depth guesses of best play */
+};
+
+/* A word of a set being searched, with its family for some letter. */
+struct lkpair {
+    uint64_t mask; /* Positions of the letter in the word */
+    int idx; /* Index of the word in the Narrow's word list */
+};
+
+/* A k-guess lookahead adversary. The adversary picks the family that
+   leaves the most words after depth more guesses, assuming the player
+   tries their likeliest letters and the adversary keeps answering with
+   the same rule.
+*/
+struct lookahead {
+    int depth; /* Number of guesses to look ahead */
+    long budget_nsec; /* Time allowed to choose one family */
+    int max_words; /* Number of words the buffers can hold */
+    uint64_t *letter_masks; /* 26 position masks per word */
+    uint64_t *keys; /* Fingerprint key of each word */
+    struct lkpair *arena; /* depth + 1 levels of max_words pairs */
+    struct ttentry *tt; /* Transposition table */
+    struct timespec deadline; /* When the current choice must be made */
+    int timed_out; /* 1 if the deadline passed during a search */
+    long nodes; /* Positions searched so far */
+};
+typedef struct lookahead Lookahead;
+
+
+Lookahead *new_lookahead(int max_words, int depth, int budget_msec);
+uint64_t lookahead_choose(Lookahead *la, Narrow *nw, char *letters_guessed);
+void deallocate_lookahead(Lookahead *la);
+
+#endif
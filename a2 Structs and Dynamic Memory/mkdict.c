@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "reading.h"
+
+/* This program takes as input a dictionary with one word per line and
+ * writes it out as a binary dictionary (see struct dict_header). wheel
+ * maps a binary dictionary into memory instead of parsing it, so it
+ * starts without any per-word work.
+ */
+
+/* Write size bytes from buf to fp, or exit. */
+static void write_or_exit(const void *buf, size_t size, FILE *fp, char *outfile) {
+    if (size > 0 && fwrite(buf, size, 1, fp) != 1) {
+        fprintf(stderr, "Could not write to %s\n", outfile);
+        exit(1);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    int ch, len, j;
+    char *infile = NULL, *outfile = NULL;
+    char **words;
+    FILE *outfp;
+    struct dict_header header;
+    uint64_t offset, i;
+    static const char padding[8];
+
+    if (argc != 5) {
+        fprintf(stderr, "Usage: mkdict -f <input file name> -o <output file name>\n");
+        exit(1);
+    }
+
+    /* read in arguments */
+    while ((ch = getopt(argc, argv, "f:o:")) != -1) {
+        switch(ch) {
+        case 'f':
+            infile = optarg;
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: mkdict -f <input file name> -o <output file name>\n");
+            exit(1);
+        }
+    }
+
+    words = read_words(infile);
+
+    /* Lay out the words, grouped by length, then their masks. */
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DICT_MAGIC, sizeof(header.magic));
+    header.version = DICT_VERSION;
+    header.max_length = MAX_WORD_LENGTH;
+    for (i = 0; words[i] != NULL; i++) {
+        header.lengths[strlen(words[i])].num_words++;
+    }
+    header.num_words = i;
+
+    offset = sizeof(header);
+    for (len = 0; len <= MAX_WORD_LENGTH; len++) {
+        struct dict_length *dl = &header.lengths[len];
+        dl->first = len == 0 ? 0 : header.lengths[len - 1].first +
+                                   header.lengths[len - 1].num_words;
+        dl->words_offset = offset;
+        offset += dl->num_words * (len + 1);
+    }
+    offset = (offset + 7) & ~(uint64_t) 7;
+    for (len = 0; len <= MAX_WORD_LENGTH; len++) {
+        struct dict_length *dl = &header.lengths[len];
+        dl->masks_offset = offset;
+        offset += dl->num_words * 26 * sizeof(uint64_t);
+    }
+    header.file_size = offset;
+
+    if ((outfp = fopen(outfile, "w")) == NULL) {
+        fprintf(stderr, "Could not open %s\n", outfile);
+        exit(1);
+    }
+    write_or_exit(&header, sizeof(header), outfp, outfile);
+
+    offset = sizeof(header);
+    for (len = 0; len <= MAX_WORD_LENGTH; len++) {
+        for (i = 0; words[i] != NULL; i++) {
+            if (strlen(words[i]) == len) {
+                write_or_exit(words[i], len + 1, outfp, outfile);
+                offset += len + 1;
+            }
+        }
+    }
+    write_or_exit(padding, ((offset + 7) & ~(uint64_t) 7) - offset, outfp, outfile);
+
+    for (len = 0; len <= MAX_WORD_LENGTH; len++) {
+        for (i = 0; words[i] != NULL; i++) {
+            uint64_t masks[26] = {0};
+            if (strlen(words[i]) != len) {
+                continue;
+            }
+            for (j = 0; j < len; j++) {
+                if (words[i][j] >= 'a' && words[i][j] <= 'z') {
+                    masks[words[i][j] - 'a'] |= (uint64_t) 1 << j;
+                }
+            }
+            write_or_exit(masks, sizeof(masks), outfp, outfile);
+        }
+    }
+
+    if (fclose(outfp)) {
+        perror("fclose");
+        exit(1);
+    }
+    deallocate_words(words);
+    return 0;
+}
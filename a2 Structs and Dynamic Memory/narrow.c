@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "narrow.h"
+#include "reading.h"
+
+
+/* Return the slot for mask in a table of size slots (a power of 2).
+   The slot is either the one already holding mask or a free one.
+*/
+static struct famslot *find_slot(struct famslot *table, int size, uint64_t mask) {
+    int i = (int) ((mask * 0x9E3779B97F4A7C15ULL) >> 32) & (size - 1);
+    while (table[i].num_words != 0 && table[i].mask != mask) {
+        i = (i + 1) & (size - 1);
+    }
+    return &table[i];
+}
+
+
+/* Return the smallest power of 2 that is at least twice n. */
+static int table_size_for(int n) {
+    int size = 2;
+    while (size < 2 * n) {
+        size *= 2;
+    }
+    return size;
+}
+
+
+/* Return the number of threads to use on the current words of nw. */
+static int threads_for(Narrow *nw) {
+    int threads = nw->num_words / NARROW_MIN_PER_THREAD;
+    if (threads > nw->num_threads) {
+        threads = nw->num_threads;
+    }
+    return threads < 1 ? 1 : threads;
+}
+
+
+/* Return a pointer to a new Narrow for word_list, a NULL-terminated list
+   of words that all have length len. word_list is narrowed in place,
+   so it must not be used by anything else while the Narrow is in use;
+   it is still freed by its owner after deallocate_narrow.
+   Big word lists are partitioned by up to num_threads threads.
+*/
+Narrow *new_narrow(char **word_list, int len, int num_threads) {
+    int i;
+    Narrow *nw = malloc(sizeof(struct narrow));
+    if(nw==NULL){
+        perror("malloc");
+        exit(1);
+    }
+    nw->word_ptrs = word_list;
+    nw->num_words = 0;
+    while (word_list[nw->num_words] != NULL) {
+        nw->num_words++;
+    }
+    nw->len = len;
+    nw->masks = malloc(nw->num_words * sizeof(uint64_t));
+    if(nw->masks==NULL){
+        perror("malloc");
+        exit(1);
+    }
+    nw->max_slots = table_size_for(nw->num_words);
+    nw->table = calloc(nw->max_slots, sizeof(struct famslot));
+    if(nw->table==NULL){
+        perror("calloc");
+        exit(1);
+    }
+    nw->table_size = 0;
+    nw->letter = '\0';
+    nw->signature = malloc(len + 1);
+    if(nw->signature==NULL){
+        perror("malloc");
+        exit(1);
+    }
+    memset(nw->signature, '-', len);
+    nw->signature[len] = '\0';
+
+    nw->num_threads = num_threads < 1 ? 1 : num_threads;
+    nw->parts = NULL;
+    nw->spare = NULL;
+    nw->own = NULL;
+    num_threads = threads_for(nw);
+    if (num_threads > 1) {
+        /* While all num_threads threads are used, slices only get smaller
+           as the word list is narrowed. Once threads_for drops to t <
+           num_threads threads, there are fewer than (t + 1) *
+           NARROW_MIN_PER_THREAD words, so a slice has fewer than
+           2 * NARROW_MIN_PER_THREAD of them. */
+        int slice = (nw->num_words + num_threads - 1) / num_threads;
+        if (slice < 2 * NARROW_MIN_PER_THREAD) {
+            slice = 2 * NARROW_MIN_PER_THREAD;
+        }
+        nw->num_threads = num_threads;
+        nw->parts = malloc(num_threads * sizeof(struct narrow_part));
+        if(nw->parts==NULL){
+            perror("malloc");
+            exit(1);
+        }
+        for (i = 0; i < num_threads; i++) {
+            nw->parts[i].nw = nw;
+            nw->parts[i].table = calloc(table_size_for(slice),
+                                        sizeof(struct famslot));
+            if(nw->parts[i].table==NULL){
+                perror("calloc");
+                exit(1);
+            }
+        }
+        nw->spare = malloc((nw->num_words + 1) * sizeof(char *));
+        if(nw->spare==NULL){
+            perror("malloc");
+            exit(1);
+        }
+        nw->own = nw->spare;
+    } else {
+        nw->num_threads = 1;
+    }
+    return nw;
+}
+
+
+/* Compute the masks of words lo to hi-1 of nw for letter, and count their
+   families in table, which has size slots. Return the number of families.
+*/
+static int count_families(Narrow *nw, int lo, int hi,
+                          struct famslot *table, int size) {
+    int i, j;
+    int num_fams = 0;
+    char letter = nw->letter;
+    struct famslot *slot;
+
+    memset(table, 0, size * sizeof(struct famslot));
+    for (i = lo; i < hi; i++) {
+        uint64_t mask = 0;
+        const uint64_t *lm = word_letter_masks(nw->word_ptrs[i], nw->len);
+        if (lm != NULL && letter >= 'a' && letter <= 'z') {
+            mask = lm[letter - 'a'];
+        } else {
+            for (j = 0; j < nw->len; j++) {
+                if (nw->word_ptrs[i][j] == letter) {
+                    mask |= (uint64_t) 1 << j;
+                }
+            }
+        }
+        nw->masks[i] = mask;
+
+        slot = find_slot(table, size, mask);
+        if (slot->num_words == 0) {
+            slot->mask = mask;
+            slot->first = i;
+            num_fams++;
+        }
+        slot->num_words++;
+    }
+    return num_fams;
+}
+
+
+/* Thread body: count the families of one part. */
+static void *count_part(void *arg) {
+    struct narrow_part *part = arg;
+    count_families(part->nw, part->lo, part->hi, part->table, part->table_size);
+    return NULL;
+}
+
+
+/* Thread body: copy the kept words of one part into spare. */
+static void *gather_part(void *arg) {
+    struct narrow_part *part = arg;
+    Narrow *nw = part->nw;
+    int i;
+    int out = part->out;
+
+    for (i = part->lo; i < part->hi; i++) {
+        if (nw->masks[i] == part->keep) {
+            nw->spare[out] = nw->word_ptrs[i];
+            out++;
+        }
+    }
+    return NULL;
+}
+
+
+/* Run body on the first num_parts parts of nw, one thread each,
+   and wait for all of them to finish.
+*/
+static void run_parts(Narrow *nw, int num_parts, void *(*body)(void *)) {
+    pthread_t tids[num_parts];
+    int i;
+
+    for (i = 1; i < num_parts; i++) {
+        if (pthread_create(&tids[i], NULL, body, &nw->parts[i]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    body(&nw->parts[0]);
+    for (i = 1; i < num_parts; i++) {
+        if (pthread_join(tids[i], NULL) != 0) {
+            perror("pthread_join");
+            exit(1);
+        }
+    }
+}
+
+
+/* Partition the current words of nw by the positions of letter, filling
+   nw->masks and the family table. Return the number of families.
+
+   With more than one thread, each thread counts one slice of the words
+   into its own table, and the tables are then merged in slice order.
+*/
+int narrow_families(Narrow *nw, char letter) {
+    int i, j;
+    int num_parts = threads_for(nw);
+    int num_fams = 0;
+
+    nw->letter = letter;
+    nw->table_size = table_size_for(nw->num_words);
+    if (num_parts == 1) {
+        return count_families(nw, 0, nw->num_words,
+                              nw->table, nw->table_size);
+    }
+
+    for (i = 0; i < num_parts; i++) {
+        struct narrow_part *part = &nw->parts[i];
+        part->lo = (long) nw->num_words * i / num_parts;
+        part->hi = (long) nw->num_words * (i + 1) / num_parts;
+        part->table_size = table_size_for(part->hi - part->lo);
+    }
+    run_parts(nw, num_parts, count_part);
+
+    memset(nw->table, 0, nw->table_size * sizeof(struct famslot));
+    for (i = 0; i < num_parts; i++) {
+        struct narrow_part *part = &nw->parts[i];
+        for (j = 0; j < part->table_size; j++) {
+            struct famslot *local = &part->table[j];
+            struct famslot *slot;
+            if (local->num_words == 0) {
+                continue;
+            }
+            slot = find_slot(nw->table, nw->table_size, local->mask);
+            if (slot->num_words == 0) {
+                /* Earlier slices did not have this family,
+                   so this slice has its first word. */
+                *slot = *local;
+                num_fams++;
+            } else {
+                slot->num_words += local->num_words;
+            }
+        }
+    }
+    return num_fams;
+}
+
+
+/* Return the mask of the biggest family found by narrow_families.
+   Ties go to the family whose first word comes last in the word list,
+   which is the family find_biggest_family picks from the list built by
+   generate_families (new families are added at the head).
+*/
+uint64_t narrow_biggest(Narrow *nw) {
+    struct famslot *max = NULL;
+    int i;
+
+    for (i = 0; i < nw->table_size; i++) {
+        struct famslot *slot = &nw->table[i];
+        if (slot->num_words == 0) {
+            continue;
+        }
+        if (max == NULL || max->num_words < slot->num_words ||
+            (max->num_words == slot->num_words && max->first < slot->first)) {
+            max = slot;
+        }
+    }
+    return max->mask;
+}
+
+
+/* Keep only the words whose family is mask, preserving their order,
+   and return the signature of that family. Must follow narrow_families.
+*/
+char *narrow_keep(Narrow *nw, uint64_t mask) {
+    int i, j;
+    int kept = 0;
+    int num_parts = threads_for(nw);
+
+    if (num_parts == 1) {
+        for (i = 0; i < nw->num_words; i++) {
+            if (nw->masks[i] == mask) {
+                nw->word_ptrs[kept] = nw->word_ptrs[i];
+                kept++;
+            }
+        }
+    } else {
+        /* Each part's table says how many words it keeps, which fixes
+           where in spare its words go. */
+        for (i = 0; i < num_parts; i++) {
+            struct narrow_part *part = &nw->parts[i];
+            part->keep = mask;
+            part->out = kept;
+            kept += find_slot(part->table, part->table_size, mask)->num_words;
+        }
+        run_parts(nw, num_parts, gather_part);
+
+        char **tmp = nw->word_ptrs;
+        nw->word_ptrs = nw->spare;
+        nw->spare = tmp;
+    }
+    nw->word_ptrs[kept] = NULL;
+    nw->num_words = kept;
+
+    for (j = 0; j < nw->len; j++) {
+        nw->signature[j] = (mask >> j) & 1 ? nw->letter : '-';
+    }
+    return nw->signature;
+}
+
+
+/* Narrow the words of nw to the biggest family for letter, and
+   return the signature of that family.
+*/
+char *narrow_word_list(Narrow *nw, char letter) {
+    narrow_families(nw, letter);
+    return narrow_keep(nw, narrow_biggest(nw));
+}
+
+
+/* Replace the current words of nw by the num_words words of word_list,
+   whose family has the given signature. The words must be some of the
+   current words of nw, such as a family chosen earlier for the same
+   guesses. Return nw's copy of the signature.
+*/
+char *narrow_restore(Narrow *nw, char **word_list, int num_words, char *signature) {
+    memmove(nw->word_ptrs, word_list, num_words * sizeof(char *));
+    nw->word_ptrs[num_words] = NULL;
+    nw->num_words = num_words;
+    strcpy(nw->signature, signature);
+    return nw->signature;
+}
+
+
+/* Fill fam so that it describes the current words of nw. fam shares
+   its memory with nw, so it must not be passed to deallocate_families.
+*/
+void narrow_as_family(Narrow *nw, Family *fam) {
+    fam->signature = nw->signature;
+    fam->word_ptrs = nw->word_ptrs;
+    fam->num_words = nw->num_words;
+    fam->max_words = nw->num_words;
+    fam->next = NULL;
+}
+
+
+/* Deallocate all memory acquired by new_narrow. */
+void deallocate_narrow(Narrow *nw) {
+    int i;
+
+    if (nw == NULL) {
+        return;
+    }
+    if (nw->parts) {
+        for (i = 0; i < nw->num_threads; i++) {
+            free(nw->parts[i].table);
+        }
+        free(nw->parts);
+    }
+    free(nw->own);
+    free(nw->masks);
+    free(nw->table);
+    free(nw->signature);
+    free(nw);
+}
@@ -0,0 +1,62 @@
+#ifndef NARROW_H
+#define NARROW_H
+
+#include <stdint.h>
+#include "family.h"
+
+/* One family in the table built by narrow_families. */
+struct famslot {
+    uint64_t mask; /* Positions of the guessed letter; bit j is position j */
+    int num_words; /* Number of words in family; 0 means the slot is free */
+    int first; /* Index in the word list of the family's first word */
+};
+
+/* One thread's share of the work in narrow_families and narrow_keep. */
+struct narrow_part {
+    struct narrow *nw; /* Narrow this part belongs to */
+    int lo; /* Index of the part's first word */
+    int hi; /* Index one past the part's last word */
+    struct famslot *table; /* This part's own family table */
+    int table_size; /* Number of slots used in table */
+    uint64_t keep; /* Family kept by narrow_keep */
+    int out; /* Index in spare of the part's first kept word */
+};
+
+/* A word list that is narrowed in place from one guess to the next.
+   All memory is allocated by new_narrow, so a round played with
+   narrow_word_list does no heap allocation after setup.
+   With more than one thread, big word lists are partitioned by slices
+   and the kept words are gathered into spare, which then swaps places
+   with word_ptrs.
+*/
+struct narrow {
+    char **word_ptrs; /* Current words; NULL-terminated */
+    int num_words; /* Number of words in word_ptrs */
+    int len; /* Length of every word in word_ptrs */
+    uint64_t *masks; /* masks[i] is the family of word_ptrs[i] for letter */
+    struct famslot *table; /* Open-addressing table of families */
+    int table_size; /* Number of slots used by the last narrow_families */
+    int max_slots; /* Number of slots allocated for table */
+    char letter; /* Letter used by the last narrow_families */
+    char *signature; /* Signature of the family kept by narrow_keep */
+    int num_threads; /* Number of threads to use on big word lists */
+    struct narrow_part *parts; /* One part per thread, or NULL */
+    char **spare; /* Buffer the threads gather kept words into, or NULL */
+    char **own; /* The buffer allocated by new_narrow for spare */
+};
+typedef struct narrow Narrow;
+
+
+/* Minimum number of words each thread works on. */
+#define NARROW_MIN_PER_THREAD 4096
+
+Narrow *new_narrow(char **word_list, int len, int num_threads);
+int narrow_families(Narrow *nw, char letter);
+uint64_t narrow_biggest(Narrow *nw);
+char *narrow_keep(Narrow *nw, uint64_t mask);
+char *narrow_word_list(Narrow *nw, char letter);
+char *narrow_restore(Narrow *nw, char **word_list, int num_words, char *signature);
+void narrow_as_family(Narrow *nw, Family *fam);
+void deallocate_narrow(Narrow *nw);
+
+#endif
@@ -2,13 +2,87 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-/* Read all words from filename and return them in a 2D array. */
+/* The binary dictionary read by read_words, if any. */
+static struct dict_header *dict = NULL;
+
+/* The word list read_words made for dict. */
+static char **dict_words = NULL;
+
+
+/* Map the binary dictionary open on fd, and return its words.
+   The words point into the mapping, so nothing is copied or parsed.
+*/
+static char **map_dictionary(char *filename, int fd) {
+    struct stat sbuf;
+    char *base;
+    char **words;
+    int len;
+    uint64_t i;
+
+    if (fstat(fd, &sbuf) == -1) {
+        perror("fstat");
+        exit(1);
+    }
+    if (sbuf.st_size < sizeof(struct dict_header)) {
+        fprintf(stderr, "%s: truncated dictionary\n", filename);
+        exit(1);
+    }
+    base = mmap(NULL, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    dict = (struct dict_header *) base;
+    if (dict->version != DICT_VERSION || dict->max_length != MAX_WORD_LENGTH ||
+        dict->file_size != sbuf.st_size) {
+        fprintf(stderr, "%s: dictionary was made by another version of mkdict\n",
+                filename);
+        exit(1);
+    }
+
+    words = malloc((dict->num_words + 1) * sizeof(*words));
+    if (words == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (len = 0; len <= MAX_WORD_LENGTH; len++) {
+        struct dict_length *dl = &dict->lengths[len];
+        uint64_t size = sbuf.st_size;
+        /* Written as divisions so that a corrupt count cannot overflow. */
+        if (dl->first > dict->num_words ||
+            dl->num_words > dict->num_words - dl->first ||
+            dl->words_offset > size ||
+            dl->num_words > (size - dl->words_offset) / (len + 1) ||
+            dl->masks_offset > size ||
+            dl->num_words > (size - dl->masks_offset) / (26 * sizeof(uint64_t))) {
+            fprintf(stderr, "%s: truncated dictionary\n", filename);
+            exit(1);
+        }
+        for (i = 0; i < dl->num_words; i++) {
+            words[dl->first + i] = base + dl->words_offset + i * (len + 1);
+        }
+    }
+    words[dict->num_words] = NULL;
+    dict_words = words;
+    return words;
+}
+
+
+/* Read all words from filename and return them in a 2D array.
+   filename may also be a binary dictionary made by mkdict, which is
+   mapped into memory instead of being parsed.
+*/
 char **read_words(char *filename) {
     char buffer[MAX_WORD_LENGTH + 1];
     FILE *fp;
     int word_count;
     char **words;
+    char magic[sizeof(dict->magic)];
 
     fp = fopen(filename, "r");
     if (!fp) {
@@ -16,6 +90,14 @@ char **read_words(char *filename) {
       exit(1);
     }
 
+    if (fread(magic, sizeof(magic), 1, fp) == 1 &&
+        memcmp(magic, DICT_MAGIC, sizeof(magic)) == 0) {
+        words = map_dictionary(filename, fileno(fp));
+        fclose(fp);
+        return words;
+    }
+    rewind(fp);
+
     word_count = 0;
     words = malloc(MAX_WORDS * sizeof(*words));
     if (words == NULL) {
@@ -44,9 +126,116 @@ char **read_words(char *filename) {
     return words;
 }
 
+
+/* If words came from a binary dictionary, return a pointer to the first
+   of its words of length len, which are next to each other in words,
+   and store their number in count. Otherwise return NULL.
+*/
+char **words_of_length(char **words, int len, int *count) {
+    if (words != dict_words || len < 0 || len > MAX_WORD_LENGTH) {
+        return NULL;
+    }
+    *count = dict->lengths[len].num_words;
+    return words + dict->lengths[len].first;
+}
+
+
+/* Return the 26 letter position masks of word, which has length len,
+   or NULL if word is not from a binary dictionary.
+*/
+const uint64_t *word_letter_masks(char *word, int len) {
+    struct dict_length *dl;
+    char *start;
+    uint64_t i;
+
+    if (dict == NULL || len < 0 || len > MAX_WORD_LENGTH) {
+        return NULL;
+    }
+    dl = &dict->lengths[len];
+    start = (char *) dict + dl->words_offset;
+    if (word < start || word >= start + dl->num_words * (len + 1)) {
+        return NULL;
+    }
+    i = (word - start) / (len + 1);
+    return (uint64_t *) ((char *) dict + dl->masks_offset) + i * 26;
+}
+
+
+/* Starting with words (returned by read_words), generate and return
+   a new word list with only those words of length len. Also, fill
+   words_remaining with the number of words in the new word list.
+
+   Allocate exactly enough memory to store only those words of length len.
+
+   Note: Do not make copies of the words.
+*/
+char **prune_word_list(char **words, int len, int *words_remaining) {
+    int i=0;
+    char **same_length=words_of_length(words, len, words_remaining);
+    if(same_length!=NULL){
+        /* A binary dictionary already has these words next to each other. */
+        char **result=NULL;
+        if(*words_remaining!=0){
+            result=malloc((*words_remaining+1)*sizeof(char*));
+            if(result==NULL){
+                perror("malloc");
+                exit(1);
+            }
+            memcpy(result, same_length, *words_remaining*sizeof(char*));
+            result[*words_remaining]=NULL;
+        }
+        return result;
+    }
+    *words_remaining=0;
+    while(words[i]!=NULL){
+	if(strlen(words[i])==len){
+		(*words_remaining)++;
+	}
+	i++;
+    }
+    char ** result;
+    if(*words_remaining!=0){
+    	result=malloc((*words_remaining+1)*sizeof(char*));
+    	if(result==NULL){
+		perror("malloc");
+		exit(1);
+    	}
+    	i=0;
+    	int j=0;
+    	while(words[i]!=NULL){
+		if(strlen(words[i])==len){
+			result[j]=words[i];
+			j++;
+		}
+		i++;
+    	}
+    	result[*words_remaining]=NULL;
+    }else{
+	result=NULL;
+    }
+    
+    return result;
+}
+
+
+/* Free memory acquired by prune_word_list.
+*/
+void deallocate_pruned_word_list(char **word_list) {
+    free(word_list);
+}
+
+
 /* Deallocate all memory acquired by read_words. */
 void deallocate_words(char **words) {
     char **p = words;
+
+    if (words == dict_words) {
+        munmap(dict, dict->file_size);
+        free(words);
+        dict = NULL;
+        dict_words = NULL;
+        return;
+    }
     while(*p) {
         free(*p);
         p++;
@@ -1,6 +1,8 @@
 #ifndef READING_H
 #define READING_H
 
+#include <stdint.h>
+
 /* Maximum length of word to read. */
 #define MAX_WORD_LENGTH 40
 
@@ -10,7 +12,40 @@
 /* Dictionary file name */
 #define DICTIONARY "dictionary.txt"
 
+/* Binary dictionaries made by mkdict start with this magic string. */
+#define DICT_MAGIC "WHEELDIC"
+
+/* Version of the binary dictionary format. */
+#define DICT_VERSION 1
+
+/* Where the words of one length are in a binary dictionary. */
+struct dict_length {
+    uint64_t num_words; /* Number of words of this length */
+    uint64_t first; /* Index of the first of them among all words */
+    uint64_t words_offset; /* Offset of the words; each takes length+1 bytes */
+    uint64_t masks_offset; /* Offset of the words' letter position masks */
+};
+
+/* Start of a binary dictionary. Words are grouped by length, in the
+   order they had in the text dictionary, and each word is followed by
+   its '\0'. Each word also has 26 position masks, one per letter from
+   'a' to 'z', where bit j is set if the letter is at position j.
+   All offsets are from the start of the file.
+*/
+struct dict_header {
+    char magic[8]; /* DICT_MAGIC, without its '\0' */
+    uint32_t version; /* DICT_VERSION */
+    uint32_t max_length; /* MAX_WORD_LENGTH */
+    uint64_t num_words; /* Number of words of all lengths */
+    uint64_t file_size; /* Size of the whole file */
+    struct dict_length lengths[MAX_WORD_LENGTH + 1];
+};
+
 char **read_words(char *filename);
+char **words_of_length(char **words, int len, int *count);
+const uint64_t *word_letter_masks(char *word, int len);
+char **prune_word_list(char **words, int len, int *words_remaining);
+void deallocate_pruned_word_list(char **word_list);
 void deallocate_words(char **words);
 
 #endif
@@ -1,59 +1,25 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include "famcache.h"
 #include "family.h"
+#include "lookahead.h"
+#include "narrow.h"
 #include "reading.h"
 
 #define BUF_SIZE	256
 
-/* Starting with words (returned by read_words), generate and return
-   a new word list with only those words of length len. Also, fill
-   words_remaining with the number of words in the new word list.
-
-   Allocate exactly enough memory to store only those words of length len.
-
-   Note: Do not make copies of the words.
-*/
-char **prune_word_list(char **words, int len, int *words_remaining) {
-    int i=0;
-    *words_remaining=0;
-    while(words[i]!=NULL){
-	if(strlen(words[i])==len){
-		(*words_remaining)++;
-	}
-	i++;
-    }
-    char ** result;
-    if(*words_remaining!=0){
-    	result=malloc((*words_remaining+1)*sizeof(char*));
-    	if(result==NULL){
-		perror("malloc");
-		exit(1);
-    	}
-    	i=0;
-    	int j=0;
-    	while(words[i]!=NULL){
-		if(strlen(words[i])==len){
-			result[j]=words[i];
-			j++;
-		}
-		i++;
-    	}
-    	result[*words_remaining]=NULL;
-    }else{
-	result=NULL;
-    }
-    
-    return result;
-}
-
-
-/* Free memory acquired by prune_word_list.
-*/
-void deallocate_pruned_word_list(char **word_list) {
-    free(word_list);
-}
-
+/* Settings chosen on the command line. */
+struct wheel_opts {
+    int in_place; /* 1 = narrow one word list in place instead of families */
+    int num_threads; /* Number of threads partitioning big word lists */
+    int depth; /* Guesses the adversary looks ahead; 1 = biggest family */
+    int budget; /* Milliseconds the adversary may think per guess */
+    char *dictionary; /* Text or binary (mkdict) dictionary to read */
+    FamCache *cache; /* Families chosen in earlier rounds, or NULL */
+};
 
 /* Return the word_list of all length-L words, and store that length in len.
    - ask user for the length of words to use
@@ -133,8 +99,14 @@ char get_next_guess(char *letters_guessed) {
 
 
 /*Play one game of Wheel of Misfortune */
-void play_round(char **words) {
+void play_round(char **words, struct wheel_opts *opts) {
     Family *famlist = NULL, *biggest_fam;
+    Family view; /*Current words, when there is no list of families*/
+    Narrow *nw = NULL;
+    Lookahead *la = NULL;
+    struct cache_entry *hit = NULL;
+    char history[27] = {'\0'}; /*Guesses so far, in order*/
+    char cached_sig[MAX_WORD_LENGTH + 1];
     char input_buffer[BUF_SIZE];
     char **word_list = NULL;
     int len, i, found;
@@ -173,15 +145,59 @@ void play_round(char **words) {
     memset(current_word, '-', len);
     current_word[len] = '\0';
 
+    if (opts->in_place) {
+        nw = new_narrow(word_list, len, opts->num_threads);
+        if (opts->depth > 1) {
+            la = new_lookahead(nw->num_words, opts->depth, opts->budget);
+        }
+    }
+
     while (!game_over) {
         printf("Guesses remaining: %d\n", guesses);
         printf("Word: %s\n", current_word);
         guess = get_next_guess(letters_guessed);
-        deallocate_families(famlist);
-        famlist = generate_families(word_list, guess);
-        biggest_fam = find_biggest_family(famlist);
-        
-        sig = get_family_signature(biggest_fam);
+        history[strlen(history)] = guess;
+
+        /*The lookahead adversary may choose differently each time*/
+        hit = NULL;
+        if (opts->cache && !la) {
+            hit = famcache_find(opts->cache, len, history);
+        }
+        if (hit && nw) {
+            sig = narrow_restore(nw, hit->word_ptrs, hit->num_words, hit->signature);
+        } else if (hit) {
+            view.word_ptrs = hit->word_ptrs;
+            view.num_words = hit->num_words;
+            deallocate_pruned_word_list(word_list);
+            word_list = get_new_word_list(&view);
+            strcpy(cached_sig, hit->signature);
+            view.signature = cached_sig;
+            view.word_ptrs = word_list;
+            view.max_words = view.num_words;
+            view.next = NULL;
+            biggest_fam = &view;
+            sig = cached_sig;
+        } else if (la) {
+            narrow_families(nw, guess);
+            sig = narrow_keep(nw, lookahead_choose(la, nw, letters_guessed));
+        } else if (nw) {
+            sig = narrow_word_list(nw, guess);
+        } else {
+            deallocate_families(famlist);
+            famlist = generate_families(word_list, guess);
+            biggest_fam = find_biggest_family(famlist);
+
+            sig = get_family_signature(biggest_fam);
+        }
+        if (opts->cache && !la && !hit) {
+            if (nw) {
+                famcache_add(opts->cache, len, history, sig,
+                             nw->word_ptrs, nw->num_words);
+            } else {
+                famcache_add(opts->cache, len, history, sig,
+                             biggest_fam->word_ptrs, biggest_fam->num_words);
+            }
+        }
         
         /*Search signature for letters in current_word*/
         found = 0;
@@ -206,32 +222,104 @@ void play_round(char **words) {
             guesses--;
             game_over = guesses <= 0;
         }
-        deallocate_pruned_word_list(word_list);
-        word_list = get_new_word_list(biggest_fam);
+        if (!nw && !hit) {
+            deallocate_pruned_word_list(word_list);
+            word_list = get_new_word_list(biggest_fam);
+        }
     }
 
     if (guesses == 0) {
+        if (nw) {
+            narrow_as_family(nw, &view);
+            biggest_fam = &view;
+        }
         printf("You lose! The word was %s.\n",
                 get_random_word_from_family(biggest_fam));
     }
     
+    deallocate_lookahead(la);
+    deallocate_narrow(nw);
     deallocate_pruned_word_list(word_list);
     free(current_word);
     deallocate_families(famlist);
 }
 
 
+/* Print how to run wheel and exit. */
+static void usage(void) {
+    fprintf(stderr, "Usage: wheel [-i] [-t <threads>] [-k <depth> [-b <msec>]] [-d <dictionary>] [-c <KB>]\n");
+    exit(1);
+}
+
+
 /* Read words, initialize families, and play as long as
-   the user answers 'y'. */
-int main(void) {
+   the user answers 'y'.
+   With -i, each round narrows a single word list in place instead of
+   building a new list of families for every guess.
+   With -t <threads>, big word lists are also partitioned in parallel.
+   With -k <depth>, the adversary looks depth guesses ahead instead of
+   taking the biggest family, thinking at most -b <msec> per guess.
+   With -d <dictionary>, words are read from that file, which may be a
+   binary dictionary made by mkdict.
+   With -c <KB>, the family chosen after each sequence of guesses is
+   cached across rounds in at most that much memory, so that replayed
+   openings skip partitioning the words.
+*/
+int main(int argc, char *argv[]) {
     char again;
     char **words;
+    int opt;
+    long kb;
+    struct wheel_opts opts = {0, 1, 1, 200, DICTIONARY, NULL};
+
+    while ((opt = getopt(argc, argv, "it:k:b:d:c:")) != -1) {
+        switch (opt) {
+        case 'i':
+            opts.in_place = 1;
+            break;
+        case 't':
+            opts.in_place = 1;
+            opts.num_threads = strtol(optarg, NULL, 10);
+            if (opts.num_threads < 1) {
+                opts.num_threads = 1;
+            }
+            break;
+        case 'k':
+            opts.in_place = 1;
+            opts.depth = strtol(optarg, NULL, 10);
+            if (opts.depth < 1) {
+                opts.depth = 1;
+            } else if (opts.depth > LOOKAHEAD_MAX_DEPTH) {
+                opts.depth = LOOKAHEAD_MAX_DEPTH;
+            }
+            break;
+        case 'b':
+            opts.budget = strtol(optarg, NULL, 10);
+            if (opts.budget < 1) {
+                opts.budget = 1;
+            }
+            break;
+        case 'd':
+            opts.dictionary = optarg;
+            break;
+        case 'c':
+            kb = strtol(optarg, NULL, 10);
+            if (kb < 1 || kb > LONG_MAX / 1024) {
+                usage();
+            }
+            deallocate_famcache(opts.cache);
+            opts.cache = new_famcache(kb * 1024L);
+            break;
+        default:
+            usage();
+        }
+    }
     
-    words = read_words("dictionary.txt");
+    words = read_words(opts.dictionary);
     init_family(1024);    
 
     do {
-        play_round(words);
+        play_round(words, &opts);
         printf("Play another round (y/n)? ");
         if (scanf(" %c", &again) != 1) {
             perror("scanf");
@@ -242,6 +330,10 @@ int main(void) {
 
     } while (again == 'y');
   
+    if (opts.cache) {
+        print_famcache_stats(opts.cache, stderr);
+        deallocate_famcache(opts.cache);
+    }
     deallocate_words(words);
     return 0;
 }
@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "famcache.h"
+#include "family.h"
+#include "lookahead.h"
+#include "narrow.h"
+#include "reading.h"
+
+/* This program plays many rounds of Wheel of Misfortune without a human:
+ * an automatic guesser plays against the adversary of wheel, and the time
+ * and heap allocations of every adversary move are recorded. The results
+ * are written to stdout as JSON, so runs of the family engine can be
+ * compared to catch regressions.
+ *
+ * The program is linked with --wrap for the allocation functions (see the
+ * Makefile), so every call from the engine goes through the counters below.
+ */
+
+#define USAGE "Usage: wheelsim [-r <rounds>] [-l <min>-<max>] [-g <guesses>] " \
+              "[-s freq|order|random] [-e list|inplace] [-t <threads>] " \
+              "[-k <depth> [-b <msec>]] [-d <dictionary>] [-c <KB>] [-S <seed>]\n"
+
+/* Letters of English text, most common first. */
+#define LETTER_ORDER "etaoinshrdlcumwfgypbvkjxqz"
+
+/* Settings chosen on the command line. */
+struct sim_opts {
+    int rounds; /* Number of rounds to play */
+    int min_len; /* Shortest word length played */
+    int max_len; /* Longest word length played */
+    int guesses; /* Wrong guesses allowed per round */
+    char guesser; /* 'f'requency, 'o'rder or 'r'andom */
+    int in_place; /* 1 = narrow in place, 0 = generate_families */
+    int num_threads; /* Threads for the in-place engine */
+    int depth; /* Lookahead of the adversary; 1 = biggest family */
+    int budget; /* Milliseconds per lookahead move */
+    char *dictionary; /* Dictionary to read */
+    unsigned int seed; /* Seed of the random guesser */
+    FamCache *cache; /* Families chosen in earlier rounds, or NULL */
+};
+
+/* Results for one word length. */
+struct length_stats {
+    int rounds;
+    int wins;
+    long moves; /* Adversary moves made */
+    double usec; /* Total time of those moves */
+};
+
+/* Results of the whole run. */
+struct sim_stats {
+    double *latencies; /* Time of each adversary move, in microseconds */
+    long num_moves;
+    long max_moves;
+    long move_allocs; /* Allocations made during adversary moves */
+    long setup_allocs; /* Allocations made setting up rounds */
+    struct length_stats lengths[MAX_WORD_LENGTH + 1];
+};
+
+/* Number of calls to each allocation function so far. */
+static long num_mallocs, num_callocs, num_reallocs, num_frees;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+    __atomic_add_fetch(&num_mallocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    __atomic_add_fetch(&num_callocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    __atomic_add_fetch(&num_reallocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+    if (ptr != NULL) {
+        __atomic_add_fetch(&num_frees, 1, __ATOMIC_RELAXED);
+    }
+    __real_free(ptr);
+}
+
+
+/* Return the number of allocations made so far. */
+static long allocations(void) {
+    return num_mallocs + num_callocs + num_reallocs;
+}
+
+
+/* Return the current time in microseconds. */
+static double now_usec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+/* Return the guesser's next letter, given the words still possible
+   (which are the adversary's current word list) and the guesses so far.
+*/
+static char next_guess(struct sim_opts *opts, char **word_list,
+                       char *letters_guessed) {
+    int counts[26] = {0};
+    int i, c, best;
+
+    if (opts->guesser == 'r') {
+        do {
+            c = rand_r(&opts->seed) % 26;
+        } while (letters_guessed[c]);
+        return 'a' + c;
+    }
+    if (opts->guesser == 'o') {
+        for (i = 0; LETTER_ORDER[i] != '\0'; i++) {
+            if (!letters_guessed[LETTER_ORDER[i] - 'a']) {
+                break;
+            }
+        }
+        return LETTER_ORDER[i];
+    }
+
+    /* Guess the letter in the most possible words. */
+    for (i = 0; word_list[i] != NULL; i++) {
+        int seen = 0;
+        char *p;
+        for (p = word_list[i]; *p; p++) {
+            c = *p - 'a';
+            if (c >= 0 && c < 26 && !(seen >> c & 1)) {
+                seen |= 1 << c;
+                counts[c]++;
+            }
+        }
+    }
+    best = -1;
+    for (c = 0; c < 26; c++) {
+        if (!letters_guessed[c] && (best == -1 || counts[c] > counts[best])) {
+            best = c;
+        }
+    }
+    return 'a' + best;
+}
+
+
+/* Record one adversary move that took usec microseconds. */
+static void record_move(struct sim_stats *st, struct length_stats *ls, double usec) {
+    if (st->num_moves == st->max_moves) {
+        st->max_moves = st->max_moves ? 2 * st->max_moves : 4096;
+        st->latencies = realloc(st->latencies, st->max_moves * sizeof(double));
+        if (st->latencies == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    st->latencies[st->num_moves++] = usec;
+    ls->moves++;
+    ls->usec += usec;
+}
+
+
+/* Play one round with words of length len, and record it in st. */
+static void play_sim_round(char **words, int len, struct sim_opts *opts,
+                           struct sim_stats *st) {
+    struct length_stats *ls = &st->lengths[len];
+    Family *famlist = NULL, *biggest_fam;
+    Narrow *nw = NULL;
+    Lookahead *la = NULL;
+    Family view;
+    struct cache_entry *hit;
+    char history[27] = {'\0'};
+    char cached_sig[MAX_WORD_LENGTH + 1];
+    char **word_list;
+    char letters_guessed[26] = {'\0'};
+    char current_word[MAX_WORD_LENGTH + 1];
+    int guesses = opts->guesses;
+    int game_over = 0;
+    int num_words, i, found;
+    long allocs;
+    double start;
+    char guess;
+    char *sig;
+
+    allocs = allocations();
+    word_list = prune_word_list(words, len, &num_words);
+    if (opts->in_place) {
+        nw = new_narrow(word_list, len, opts->num_threads);
+        if (opts->depth > 1) {
+            la = new_lookahead(num_words, opts->depth, opts->budget);
+        }
+    }
+    st->setup_allocs += allocations() - allocs;
+    memset(current_word, '-', len);
+    current_word[len] = '\0';
+
+    while (!game_over) {
+        guess = next_guess(opts, nw ? nw->word_ptrs : word_list, letters_guessed);
+        letters_guessed[guess - 'a'] = guess;
+        history[strlen(history)] = guess;
+
+        allocs = allocations();
+        start = now_usec();
+        hit = NULL;
+        if (opts->cache && !la) {
+            hit = famcache_find(opts->cache, len, history);
+        }
+        if (hit && nw) {
+            sig = narrow_restore(nw, hit->word_ptrs, hit->num_words, hit->signature);
+        } else if (hit) {
+            view.word_ptrs = hit->word_ptrs;
+            view.num_words = hit->num_words;
+            deallocate_pruned_word_list(word_list);
+            word_list = get_new_word_list(&view);
+            strcpy(cached_sig, hit->signature);
+            sig = cached_sig;
+        } else if (la) {
+            narrow_families(nw, guess);
+            sig = narrow_keep(nw, lookahead_choose(la, nw, letters_guessed));
+        } else if (nw) {
+            sig = narrow_word_list(nw, guess);
+        } else {
+            deallocate_families(famlist);
+            famlist = generate_families(word_list, guess);
+            biggest_fam = find_biggest_family(famlist);
+            sig = get_family_signature(biggest_fam);
+            deallocate_pruned_word_list(word_list);
+            word_list = get_new_word_list(biggest_fam);
+        }
+        if (opts->cache && !la && !hit) {
+            famcache_add(opts->cache, len, history, sig,
+                         nw ? nw->word_ptrs : word_list,
+                         nw ? nw->num_words : biggest_fam->num_words);
+        }
+        record_move(st, ls, now_usec() - start);
+        st->move_allocs += allocations() - allocs;
+
+        found = 0;
+        for (i = 0; sig[i] != '\0'; i++) {
+            if (sig[i] == guess) {
+                found = 1;
+                current_word[i] = guess;
+            }
+        }
+        if (found) {
+            game_over = strchr(current_word, '-') == NULL;
+        } else {
+            guesses--;
+            game_over = guesses <= 0;
+        }
+    }
+
+    ls->rounds++;
+    if (guesses > 0) {
+        ls->wins++;
+    }
+    deallocate_lookahead(la);
+    deallocate_narrow(nw);
+    deallocate_pruned_word_list(word_list);
+    deallocate_families(famlist);
+}
+
+
+/* Compare two latencies for qsort. */
+static int compare_doubles(const void *p1, const void *p2) {
+    double a = *(const double *) p1;
+    double b = *(const double *) p2;
+    return (a > b) - (a < b);
+}
+
+
+/* Return the p-th percentile of the n sorted values. */
+static double percentile(double *sorted, long n, double p) {
+    long i = (long) (p / 100 * n);
+    if (i >= n) {
+        i = n - 1;
+    }
+    return n == 0 ? 0 : sorted[i];
+}
+
+
+/* Write the results as JSON to stdout. */
+static void print_stats(struct sim_opts *opts, struct sim_stats *st) {
+    double total = 0;
+    long i;
+    int len, first = 1;
+    int rounds = 0;
+
+    for (i = 0; i < st->num_moves; i++) {
+        total += st->latencies[i];
+    }
+    qsort(st->latencies, st->num_moves, sizeof(double), compare_doubles);
+    for (len = 0; len <= MAX_WORD_LENGTH; len++) {
+        rounds += st->lengths[len].rounds;
+    }
+
+    printf("{\n");
+    printf("  \"engine\": \"%s\",\n", opts->in_place ? "inplace" : "list");
+    printf("  \"threads\": %d,\n", opts->num_threads);
+    printf("  \"depth\": %d,\n", opts->depth);
+    printf("  \"guesser\": \"%s\",\n", opts->guesser == 'f' ? "freq" :
+                                      opts->guesser == 'o' ? "order" : "random");
+    printf("  \"rounds\": %d,\n", rounds);
+    printf("  \"moves\": %ld,\n", st->num_moves);
+    printf("  \"latency_usec\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+           "\"p99\": %.3f, \"max\": %.3f},\n",
+           st->num_moves ? total / st->num_moves : 0,
+           percentile(st->latencies, st->num_moves, 50),
+           percentile(st->latencies, st->num_moves, 90),
+           percentile(st->latencies, st->num_moves, 99),
+           st->num_moves ? st->latencies[st->num_moves - 1] : 0);
+    printf("  \"allocs_per_move\": %.3f,\n",
+           st->num_moves ? (double) st->move_allocs / st->num_moves : 0);
+    printf("  \"setup_allocs_per_round\": %.3f,\n",
+           rounds ? (double) st->setup_allocs / rounds : 0);
+    if (opts->cache) {
+        printf("  \"cache\": {\"hits\": %ld, \"misses\": %ld, \"evictions\": %ld, "
+               "\"bytes\": %zu},\n", opts->cache->hits, opts->cache->misses,
+               opts->cache->evictions, opts->cache->used);
+    }
+    printf("  \"lengths\": [");
+    for (len = 0; len <= MAX_WORD_LENGTH; len++) {
+        struct length_stats *ls = &st->lengths[len];
+        if (ls->rounds == 0) {
+            continue;
+        }
+        printf("%s\n    {\"length\": %d, \"rounds\": %d, \"wins\": %d, "
+               "\"win_rate\": %.4f, \"moves\": %ld, \"mean_latency_usec\": %.3f}",
+               first ? "" : ",", len, ls->rounds, ls->wins,
+               (double) ls->wins / ls->rounds, ls->moves, ls->usec / ls->moves);
+        first = 0;
+    }
+    printf("\n  ]\n}\n");
+}
+
+
+int main(int argc, char *argv[]) {
+    struct sim_opts opts = {1000, 4, 12, 10, 'f', 0, 1, 1, 200, DICTIONARY, 1, NULL};
+    struct sim_stats st;
+    char **words;
+    int opt, round, len, tries, num_words;
+    char **probe;
+
+    while ((opt = getopt(argc, argv, "r:l:g:s:e:t:k:b:d:c:S:")) != -1) {
+        switch (opt) {
+        case 'r':
+            opts.rounds = strtol(optarg, NULL, 10);
+            break;
+        case 'l':
+            if (sscanf(optarg, "%d-%d", &opts.min_len, &opts.max_len) != 2) {
+                opts.max_len = opts.min_len;
+            }
+            break;
+        case 'g':
+            opts.guesses = strtol(optarg, NULL, 10);
+            break;
+        case 's':
+            opts.guesser = optarg[0];
+            break;
+        case 'e':
+            opts.in_place = strcmp(optarg, "inplace") == 0;
+            break;
+        case 't':
+            opts.in_place = 1;
+            opts.num_threads = strtol(optarg, NULL, 10);
+            break;
+        case 'k':
+            opts.in_place = 1;
+            opts.depth = strtol(optarg, NULL, 10);
+            break;
+        case 'b':
+            opts.budget = strtol(optarg, NULL, 10);
+            break;
+        case 'd':
+            opts.dictionary = optarg;
+            break;
+        case 'c':
+            deallocate_famcache(opts.cache);
+            opts.cache = new_famcache(strtol(optarg, NULL, 10) * 1024L);
+            break;
+        case 'S':
+            opts.seed = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, USAGE);
+            exit(1);
+        }
+    }
+    if (opts.rounds < 1 || opts.guesses < 1 || opts.guesses > 26 ||
+        opts.min_len < 1 || opts.max_len > MAX_WORD_LENGTH ||
+        opts.min_len > opts.max_len || strchr("for", opts.guesser) == NULL) {
+        fprintf(stderr, USAGE);
+        exit(1);
+    }
+    if (opts.num_threads < 1) {
+        opts.num_threads = 1;
+    }
+    if (opts.depth < 1) {
+        opts.depth = 1;
+    }
+
+    words = read_words(opts.dictionary);
+    init_family(1024);
+    memset(&st, 0, sizeof(st));
+
+    /* Cycle through the lengths, skipping those with no words. */
+    len = opts.min_len;
+    for (round = 0; round < opts.rounds; round++) {
+        for (tries = 0; tries <= opts.max_len - opts.min_len; tries++) {
+            probe = prune_word_list(words, len, &num_words);
+            deallocate_pruned_word_list(probe);
+            if (num_words > 0) {
+                break;
+            }
+            len = len == opts.max_len ? opts.min_len : len + 1;
+        }
+        if (num_words == 0) {
+            fprintf(stderr, "There are no words of those lengths.\n");
+            exit(1);
+        }
+        play_sim_round(words, len, &opts, &st);
+        len = len == opts.max_len ? opts.min_len : len + 1;
+    }
+
+    print_stats(&opts, &st);
+    free(st.latencies);
+    deallocate_famcache(opts.cache);
+    deallocate_words(words);
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "helper.h"
+#include "merge.h"
+#include "recsort.h"
+#include "append.h"
+
+// exit if a and b are the same file
+static void check_distinct(char *a, char *b) {
+    struct stat sa, sb;
+
+    if (stat(a, &sa) == 0 && stat(b, &sb) == 0 &&
+        sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino) {
+        fprintf(stderr, "Error: %s and %s are the same file\n", a, b);
+        exit(1);
+    }
+}
+
+/* Merge the unsorted records of deltafile into basefile, which is already
+ * sorted, and write the result to outfile. Only the delta is sorted, by
+ * n children as the shm engine sorts; then one sequential pass merges the
+ * base with the sorted slices of the delta. On equal keys base records
+ * come first, so the output is what sorting the base followed by the delta
+ * would give. If indexfile is not NULL, an index_entry for every
+ * INDEX_STRIDE-th output record is written to it, to find freq ranges
+ * without reading the whole output. The index holds freq only, so it is
+ * not made for keys that break ties by word.
+ */
+void append_sort(char *basefile, char *deltafile, char *outfile, int n,
+                 char *indexfile) {
+    long sum = get_file_size(deltafile) / sizeof(struct rec);
+    long block = WRITE_BLOCK / sizeof(struct rec);
+    struct rec *runs = NULL;
+    struct rec_reader base;
+    struct rec prev;
+    long used = 0;
+    long long written = 0;
+    FILE *index = NULL;
+
+    check_distinct(basefile, outfile);
+    check_distinct(deltafile, outfile);
+    if (get_file_size(basefile) % sizeof(struct rec) != 0) {
+        fprintf(stderr, "Error: %s is not a file of records\n", basefile);
+        exit(1);
+    }
+    if (n > sum) {
+        n = sum;
+    }
+    long start[n + 1];
+    if (n > 0) {
+        runs = sort_shared(deltafile, n, sum, start);
+    }
+
+    // run 0 is the base, and runs 1 to n the sorted slices of the delta
+    struct rec *heads[n + 1];
+    struct rec *ends[n + 1];
+    int heap_runs[n + 1];
+    struct merge_heap heap;
+    init_merge_heap(&heap, heads, heap_runs, sort_key);
+    int base_fd = open(basefile, O_RDONLY);
+    if (base_fd == -1) {
+        perror(basefile);
+        exit(1);
+    }
+    posix_fadvise(base_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    init_rec_reader(&base, base_fd, block);
+    if ((heads[0] = next_rec(&base)) != NULL) {
+        prev = *heads[0];
+        heap_push(&heap, 0);
+    }
+    for (int i = 0; i < n; i++) {
+        heads[i + 1] = runs + start[i];
+        ends[i + 1] = runs + start[i + 1];
+        heap_push(&heap, i + 1);
+    }
+
+    int out_fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd == -1) {
+        perror(outfile);
+        exit(1);
+    }
+    if (indexfile && (index = fopen(indexfile, "wb")) == NULL) {
+        perror(indexfile);
+        exit(1);
+    }
+    struct rec *out = malloc(block * sizeof(struct rec));
+    if (out == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    while (heap.size > 0) {
+        int top = heap_top(&heap);
+        out[used++] = *heads[top];
+        if (index && written % INDEX_STRIDE == 0) {
+            struct index_entry entry = {heads[top]->freq, 0, written};
+            if (fwrite(&entry, sizeof(entry), 1, index) != 1) {
+                fprintf(stderr, "Error: could not write %s\n", indexfile);
+                exit(1);
+            }
+        }
+        written++;
+        if (used == block) {
+            if (write_full(out_fd, out, used * sizeof(struct rec)) == -1) {
+                perror("write");
+                exit(1);
+            }
+            used = 0;
+        }
+        if (top == 0) {
+            if ((heads[0] = next_rec(&base)) == NULL) {
+                heap_pop(&heap);
+                continue;
+            }
+            // the base has to be sorted for one pass to be enough
+            if (rec_compare(sort_key, &prev, heads[0]) > 0) {
+                fprintf(stderr, "Error: %s is not sorted\n", basefile);
+                // leave no half-written output behind
+                unlink(outfile);
+                if (index) {
+                    unlink(indexfile);
+                }
+                exit(1);
+            }
+            prev = *heads[0];
+        } else if (++heads[top] == ends[top]) {
+            heap_pop(&heap);
+            continue;
+        }
+        heap_sift_top(&heap);
+    }
+    if (write_full(out_fd, out, used * sizeof(struct rec)) == -1) {
+        perror("write");
+        exit(1);
+    }
+    free(out);
+    free_rec_reader(&base);
+    close(base_fd);
+    if (close(out_fd) == -1) {
+        perror("close");
+        exit(1);
+    }
+    if (index && fclose(index) != 0) {
+        perror("fclose");
+        exit(1);
+    }
+    if (runs && munmap(runs, (size_t) sum * sizeof(struct rec)) == -1) {
+        perror("munmap");
+        exit(1);
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef _APPEND_H
+#define _APPEND_H
+
+/* Number of records between two entries of the sparse index. */
+#define INDEX_STRIDE 4096
+
+/* An entry of the sparse index: record number record of the output file
+ * has this freq. Only the freq is kept, so the index finds ranges of
+ * freq but not of words.
+ */
+struct index_entry {
+    int freq;
+    int pad;
+    long long record;
+};
+
+void append_sort(char *basefile, char *deltafile, char *outfile, int n,
+                 char *indexfile);
+
+#endif /* _APPEND_H */
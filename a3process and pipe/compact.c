@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "compact.h"
+
+/* Return 1 if filename is in the compact format, and 0 if it is not. */
+int is_compact(char *filename) {
+    char magic[sizeof(COMPACT_MAGIC) - 1];
+    int fd = open(filename, O_RDONLY);
+    int result;
+
+    if (fd == -1) {
+        perror("open");
+        exit(1);
+    }
+    result = read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+             memcmp(magic, COMPACT_MAGIC, sizeof(magic)) == 0;
+    close(fd);
+    return result;
+}
+
+/* Return the number of records in the compact file filename. */
+long compact_records(char *filename) {
+    struct compact_header header;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd == -1) {
+        perror("open");
+        exit(1);
+    }
+    free(read_compact_header(fd, &header));
+    close(fd);
+    return header.count;
+}
+
+/* Read the header of the compact file open on fd into header, and return
+ * its index, which the caller must free.
+ */
+uint64_t *read_compact_header(int fd, struct compact_header *header) {
+    uint64_t *index;
+
+    read_range(fd, header, sizeof(*header), 0);
+    if (memcmp(header->magic, COMPACT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != COMPACT_VERSION || header->stride == 0 ||
+        header->index_size != (header->count + header->stride - 1) / header->stride) {
+        fprintf(stderr, "Error: not a compact file of version %d\n", COMPACT_VERSION);
+        exit(1);
+    }
+    if ((index = malloc((header->index_size + 1) * sizeof(uint64_t))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    read_range(fd, index, header->index_size * sizeof(uint64_t), sizeof(*header));
+    return index;
+}
+
+/* Write r to out in the compact layout and return the number of bytes. */
+size_t encode_rec(char *out, struct rec *r) {
+    size_t len = strnlen(r->word, SIZE - 1);
+
+    memcpy(out, &r->freq, 4);
+    out[4] = len;
+    memcpy(out + 5, r->word, len);
+    return 5 + len;
+}
+
+/* Read a compact record from the avail bytes at in into r, with the rest
+ * of its word zeroed. Return the number of bytes it took, or 0 if avail
+ * does not hold all of it.
+ */
+size_t decode_rec(char *in, size_t avail, struct rec *r) {
+    size_t len;
+
+    if (avail < 5) {
+        return 0;
+    }
+    len = (unsigned char) in[4];
+    if (len > SIZE - 1) {
+        fprintf(stderr, "Error: word of %zu bytes in compact record\n", len);
+        exit(1);
+    }
+    if (avail < 5 + len) {
+        return 0;
+    }
+    memcpy(&r->freq, in, 4);
+    memcpy(r->word, in + 5, len);
+    memset(r->word + len, '\0', SIZE - len);
+    return 5 + len;
+}
+
+/* Set up reader to read count records, or all if count is -1, from the
+ * current offset of fd, cap bytes at a time.
+ */
+void init_compact_reader(struct compact_reader *reader, int fd, size_t cap, long count) {
+    reader->fd = fd;
+    reader->pos = 0;
+    reader->len = 0;
+    reader->cap = cap < COMPACT_MAX ? COMPACT_MAX : cap;
+    reader->left = count;
+    if ((reader->buf = malloc(reader->cap)) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+}
+
+/* Return a pointer to the next record from reader, or NULL if there are
+ * no more records. The record stays valid until the next call.
+ */
+struct rec *next_compact(struct compact_reader *reader) {
+    size_t used;
+
+    if (reader->left == 0) {
+        return NULL;
+    }
+    while ((used = decode_rec(reader->buf + reader->pos, reader->len - reader->pos,
+                              &reader->rec)) == 0) {
+        // keep the partial record and read more after it
+        memmove(reader->buf, reader->buf + reader->pos, reader->len - reader->pos);
+        reader->len -= reader->pos;
+        reader->pos = 0;
+        ssize_t got = read(reader->fd, reader->buf + reader->len,
+                           reader->cap - reader->len);
+        if (got == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            exit(1);
+        }
+        if (got == 0) {
+            if (reader->len > 0 || reader->left > 0) {
+                fprintf(stderr, "Error: compact records end in the middle\n");
+                exit(1);
+            }
+            return NULL;
+        }
+        reader->len += got;
+    }
+    reader->pos += used;
+    if (reader->left > 0) {
+        reader->left--;
+    }
+    return &reader->rec;
+}
+
+void free_compact_reader(struct compact_reader *reader) {
+    free(reader->buf);
+}
+
+/* Set up writer to write a compact file of count records to fd, or to
+ * write bare records down a pipe if count is -1, cap bytes at a time.
+ */
+void init_compact_writer(struct compact_writer *writer, int fd, size_t cap, long count) {
+    writer->fd = fd;
+    writer->used = 0;
+    writer->cap = cap < COMPACT_MAX ? COMPACT_MAX : cap;
+    writer->count = 0;
+    writer->index = NULL;
+    writer->index_size = 0;
+    writer->offset = 0;
+    if ((writer->buf = malloc(writer->cap)) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    if (count >= 0) {
+        // the header and index are written last, once the index is known
+        writer->index_size = (count + COMPACT_STRIDE - 1) / COMPACT_STRIDE;
+        writer->index = calloc(writer->index_size + 1, sizeof(uint64_t));
+        if (writer->index == NULL) {
+            perror("calloc");
+            exit(1);
+        }
+        writer->offset = sizeof(struct compact_header) +
+                         writer->index_size * sizeof(uint64_t);
+    }
+}
+
+// write out the bytes buffered by writer
+static void flush(struct compact_writer *writer) {
+    int result;
+
+    if (writer->index) {
+        result = pwrite_full(writer->fd, writer->buf, writer->used, writer->offset);
+    } else {
+        result = write_full(writer->fd, writer->buf, writer->used);
+    }
+    if (result == -1) {
+        perror("write");
+        exit(1);
+    }
+    writer->offset += writer->used;
+    writer->used = 0;
+}
+
+void compact_write(struct compact_writer *writer, struct rec *r) {
+    if (writer->cap - writer->used < COMPACT_MAX) {
+        flush(writer);
+    }
+    if (writer->index && writer->count % COMPACT_STRIDE == 0) {
+        if (writer->count / COMPACT_STRIDE >= writer->index_size) {
+            fprintf(stderr, "Error: more compact records than expected\n");
+            exit(1);
+        }
+        writer->index[writer->count / COMPACT_STRIDE] = writer->offset + writer->used;
+    }
+    writer->used += encode_rec(writer->buf + writer->used, r);
+    writer->count++;
+}
+
+/* Write out what is left, and for a file the header and index. */
+void finish_compact_writer(struct compact_writer *writer) {
+    flush(writer);
+    if (writer->index) {
+        struct compact_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, COMPACT_MAGIC, sizeof(header.magic));
+        header.version = COMPACT_VERSION;
+        header.stride = COMPACT_STRIDE;
+        header.count = writer->count;
+        header.index_size = writer->index_size;
+        if ((writer->count + COMPACT_STRIDE - 1) / COMPACT_STRIDE != writer->index_size ||
+            pwrite_full(writer->fd, &header, sizeof(header), 0) == -1 ||
+            pwrite_full(writer->fd, writer->index,
+                        writer->index_size * sizeof(uint64_t), sizeof(header)) == -1) {
+            fprintf(stderr, "Error: could not write compact header\n");
+            exit(1);
+        }
+        free(writer->index);
+    }
+    free(writer->buf);
+}
@@ -0,0 +1,67 @@
+#ifndef _COMPACT_H
+#define _COMPACT_H
+
+#include <stdint.h>
+#include "helper.h"
+
+/* The compact record format. A file starts with a header and an index,
+ * followed by the records. Each record is its freq as 4 bytes, the length
+ * of its word as 1 byte, and the bytes of the word without the '\0'.
+ * index[i] is the offset in the file of record i * stride, so a file can
+ * be cut into slices without reading it.
+ * Between psort's children and parent, records go in the same layout
+ * with no header or index.
+ */
+#define COMPACT_MAGIC "PSORTCMP"
+#define COMPACT_VERSION 1
+
+/* Number of records between two index entries. */
+#define COMPACT_STRIDE 4096
+
+/* Most bytes a compact record can take. */
+#define COMPACT_MAX (4 + 1 + SIZE - 1)
+
+struct compact_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t stride;
+    uint64_t count;         // number of records in the file
+    uint64_t index_size;    // number of index entries after the header
+};
+
+/* Buffered reader of compact records, from a file or a pipe. */
+struct compact_reader {
+    int fd;
+    char *buf;
+    size_t pos;             // offset in buf of the next record
+    size_t len;             // number of bytes in buf
+    size_t cap;             // number of bytes buf has room for
+    long left;              // records still to hand out, or -1 for all
+    struct rec rec;         // the record handed out last
+};
+
+/* Buffered writer of compact records, to a file or a pipe. */
+struct compact_writer {
+    int fd;
+    char *buf;
+    size_t used;            // number of bytes in buf
+    size_t cap;             // number of bytes buf has room for
+    off_t offset;           // offset in the file of the next byte
+    uint64_t count;         // number of records written
+    uint64_t *index;        // index of a file, or NULL for a pipe
+    uint64_t index_size;
+};
+
+int is_compact(char *filename);
+long compact_records(char *filename);
+uint64_t *read_compact_header(int fd, struct compact_header *header);
+size_t encode_rec(char *out, struct rec *r);
+size_t decode_rec(char *in, size_t avail, struct rec *r);
+void init_compact_reader(struct compact_reader *reader, int fd, size_t cap, long count);
+struct rec *next_compact(struct compact_reader *reader);
+void free_compact_reader(struct compact_reader *reader);
+void init_compact_writer(struct compact_writer *writer, int fd, size_t cap, long count);
+void compact_write(struct compact_writer *writer, struct rec *r);
+void finish_compact_writer(struct compact_writer *writer);
+
+#endif /* _COMPACT_H */
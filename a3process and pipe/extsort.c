@@ -0,0 +1,372 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include "helper.h"
+#include "merge.h"
+#include "extsort.h"
+#include "recsort.h"
+
+// the directory holding the runs, or "" once it is removed
+static char run_dir[4096];
+
+// the process that made run_dir, which is the one to remove it
+static pid_t run_dir_owner;
+
+// write the name of run number run into name
+static void run_name(char *name, size_t size, long run) {
+    snprintf(name, size, "%s/run%ld", run_dir, run);
+}
+
+// open run number run for reading, or for writing if create is 1
+static int open_run(long run, int create) {
+    char name[sizeof(run_dir) + 32];
+    int fd;
+
+    run_name(name, sizeof(name), run);
+    if (create) {
+        fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    } else {
+        fd = open(name, O_RDONLY);
+    }
+    if (fd == -1) {
+        perror(name);
+        exit(1);
+    }
+    return fd;
+}
+
+// delete run number run
+static void remove_run(long run) {
+    char name[sizeof(run_dir) + 32];
+
+    run_name(name, sizeof(name), run);
+    if (unlink(name) == -1) {
+        perror(name);
+        exit(1);
+    }
+}
+
+/* The work of one child: sort records [start, end) of infile into runs of
+ * at most chunk records each, numbered from first_run on.
+ */
+static void make_runs(char *infile, long start, long end, long chunk, long first_run) {
+    struct rec *buf;
+    int in_fd, out_fd;
+    long run = first_run;
+
+    if ((buf = malloc(chunk * sizeof(struct rec))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    if ((in_fd = open(infile, O_RDONLY)) == -1) {
+        perror("open");
+        exit(1);
+    }
+    while (start < end) {
+        long count = end - start < chunk ? end - start : chunk;
+        read_recs(in_fd, buf, start, count);
+        sort_recs(buf, count);
+        out_fd = open_run(run, 1);
+        if (write_full(out_fd, buf, count * sizeof(struct rec)) == -1) {
+            perror("write run");
+            exit(1);
+        }
+        if (close(out_fd) == -1) {
+            perror("close");
+            exit(1);
+        }
+        start += count;
+        run++;
+    }
+    close(in_fd);
+    free(buf);
+}
+
+/* Merge runs first to first+k-1 into out_fd, reading and writing
+ * block records at a time, and delete them.
+ */
+static void merge_runs(long first, int k, int out_fd, long block) {
+    struct rec_reader readers[k];
+    struct rec *heads[k];
+    int heap_runs[k];
+    struct merge_heap heap;
+    struct rec *out;
+    long used = 0;
+
+    if ((out = malloc(block * sizeof(struct rec))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    init_merge_heap(&heap, heads, heap_runs, sort_key);
+    for (int i = 0; i < k; i++) {
+        init_rec_reader(&readers[i], open_run(first + i, 0), block);
+        if ((heads[i] = next_rec(&readers[i])) != NULL) {
+            heap_push(&heap, i);
+        }
+    }
+    while (heap.size > 0) {
+        int top = heap_top(&heap);
+        out[used++] = *heads[top];
+        if (used == block) {
+            if (write_full(out_fd, out, used * sizeof(struct rec)) == -1) {
+                perror("write");
+                exit(1);
+            }
+            used = 0;
+        }
+        if ((heads[top] = next_rec(&readers[top])) == NULL) {
+            heap_pop(&heap);
+        } else {
+            heap_sift_top(&heap);
+        }
+    }
+    if (write_full(out_fd, out, used * sizeof(struct rec)) == -1) {
+        perror("write");
+        exit(1);
+    }
+    for (int i = 0; i < k; i++) {
+        close(readers[i].fd);
+        free_rec_reader(&readers[i]);
+        remove_run(first + i);
+    }
+    free(out);
+}
+
+/* Work out how many records to read and write at a time while merging,
+ * and how many runs to merge at once, to stay within budget bytes, or to
+ * use the defaults if budget is 0.
+ */
+static void merge_params(size_t budget, long *block, int *fan_in) {
+    *block = MERGE_BLOCK / sizeof(struct rec);
+    *fan_in = MAX_FAN_IN;
+    if (budget == 0) {
+        return;
+    }
+    // merging needs a buffer for each input run and one for the output
+    if (budget < 3 * MERGE_BLOCK) {
+        *block = budget / 3 / sizeof(struct rec);
+        if (*block < 1) {
+            *block = 1;
+        }
+    }
+    *fan_in = budget / (*block * sizeof(struct rec)) - 1;
+    if (*fan_in < 2) {
+        *fan_in = 2;
+    }
+    if (*fan_in > MAX_FAN_IN) {
+        *fan_in = MAX_FAN_IN;
+    }
+}
+
+/* At exit, remove the run directory and any runs still in it, so that a
+ * sort that fails part way does not leave them behind. Children inherit
+ * this handler, but only the process that made the directory acts on it.
+ */
+static void remove_run_dir(void) {
+    char name[sizeof(run_dir) + sizeof(((struct dirent *) 0)->d_name) + 1];
+    struct dirent *entry;
+    DIR *dir;
+
+    if (run_dir[0] == '\0' || getpid() != run_dir_owner) {
+        return;
+    }
+    if ((dir = opendir(run_dir)) != NULL) {
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                snprintf(name, sizeof(name), "%s/%s", run_dir, entry->d_name);
+                unlink(name);
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(run_dir);
+    run_dir[0] = '\0';
+}
+
+// make the directory that holds the runs, and have it removed at exit
+static void make_run_dir(void) {
+    char *tmp = getenv("TMPDIR");
+
+    snprintf(run_dir, sizeof(run_dir), "%s/psortXXXXXX", tmp ? tmp : "/tmp");
+    if (mkdtemp(run_dir) == NULL) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    run_dir_owner = getpid();
+    if (atexit(remove_run_dir) != 0) {
+        fprintf(stderr, "Error: cannot register run directory cleanup\n");
+        remove_run_dir();
+        exit(1);
+    }
+}
+
+/* Merge runs 0 to last - 1 into outfile, at most fan_in at a time, in
+ * passes until one pass can write outfile, and remove the run directory.
+ */
+static void merge_all_runs(long last, char *outfile, long block, int fan_in) {
+    // runs [first, last) are the current pass; merged runs are numbered on
+    long first = 0;
+    while (last - first > fan_in) {
+        long next = last;
+        for (long run = first; run < last; run += fan_in) {
+            int k = last - run < fan_in ? last - run : fan_in;
+            int out_fd = open_run(next++, 1);
+            merge_runs(run, k, out_fd, block);
+            if (close(out_fd) == -1) {
+                perror("close");
+                exit(1);
+            }
+        }
+        first = last;
+        last = next;
+    }
+
+    int out_fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd == -1) {
+        perror("open");
+        exit(1);
+    }
+    if (last > first) {
+        merge_runs(first, last - first, out_fd, block);
+    }
+    if (close(out_fd) == -1) {
+        perror("close");
+        exit(1);
+    }
+    if (rmdir(run_dir) == -1) {
+        perror("rmdir");
+        exit(1);
+    }
+    run_dir[0] = '\0';
+}
+
+/* Sort the sum records of infile into outfile using at most budget bytes
+ * of memory for records. n children each sort their slice of the input
+ * into runs of budget/2n bytes, which are written to a temporary directory
+ * ($TMPDIR or /tmp).
+ * The parent then merges the runs, at most as many at a time as the budget
+ * has room for buffers of MERGE_BLOCK bytes, until one pass can write the
+ * output file. Runs are always merged in input order, so the output is the
+ * same as that of the other engines.
+ */
+void external_sort(char *infile, char *outfile, int n, long sum, size_t budget) {
+    // sorting a chunk takes a scratch buffer as big as the chunk
+    long chunk = budget / n / 2 / sizeof(struct rec);
+    long first_run[n + 1];
+    long start = 0;
+    long block;
+    int fan_in;
+
+    if (chunk < 1) {
+        fprintf(stderr, "Error: memory budget is too small for %d processes\n", n);
+        exit(1);
+    }
+    merge_params(budget, &block, &fan_in);
+    make_run_dir();
+
+    // give out the slices as the other engines do, and number the runs
+    first_run[0] = 0;
+    for (int i = 0; i < n; i++) {
+        long whether = sum / n + (i < sum % n ? 1 : 0);
+        first_run[i + 1] = first_run[i] + (whether + chunk - 1) / chunk;
+    }
+    for (int i = 0; i < n; i++) {
+        long whether = sum / n + (i < sum % n ? 1 : 0);
+        int result = fork();
+        if (result < 0) {
+            perror("fork");
+            exit(1);
+        } else if (result == 0) {
+            pin_child(i);
+            make_runs(infile, start, start + whether, chunk, first_run[i]);
+            exit(0);
+        }
+        start += whether;
+    }
+    wait_children(n);
+    merge_all_runs(first_run[n], outfile, block, fan_in);
+}
+
+// read up to count records from in_fd into buf; return how many were read.
+// As with a regular input file, bytes of a partial record at the end of
+// the input are left out.
+static long read_chunk(int in_fd, struct rec *buf, long count) {
+    size_t size = count * sizeof(struct rec), have = 0;
+
+    while (have < size) {
+        ssize_t got = read(in_fd, (char *) buf + have, size - have);
+        if (got == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            exit(1);
+        }
+        if (got == 0) {
+            break;
+        }
+        have += got;
+    }
+    return have / sizeof(struct rec);
+}
+
+/* Sort the records coming from in_fd, which may be a pipe, into outfile,
+ * without knowing how many there are. The parent reads a chunk at a time
+ * and forks a child to sort each chunk into a run while it reads the next
+ * one, with at most n children at once. At the end of the input it merges
+ * the runs as external_sort does. Chunks are budget/2n bytes, or
+ * STREAM_CHUNK records if there is no budget.
+ */
+void stream_sort(int in_fd, char *outfile, int n, size_t budget) {
+    long chunk = budget ? budget / n / 2 / sizeof(struct rec) : STREAM_CHUNK;
+    long runs = 0, count;
+    int running = 0;
+    long block;
+    int fan_in;
+    struct rec *buf;
+
+    if (chunk < 1) {
+        fprintf(stderr, "Error: memory budget is too small for %d processes\n", n);
+        exit(1);
+    }
+    merge_params(budget, &block, &fan_in);
+    if ((buf = malloc(chunk * sizeof(struct rec))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    make_run_dir();
+
+    while ((count = read_chunk(in_fd, buf, chunk)) > 0) {
+        if (running == n) {
+            wait_children(1);
+            running--;
+        }
+        int result = fork();
+        if (result < 0) {
+            perror("fork");
+            exit(1);
+        } else if (result == 0) {
+            pin_child(runs);
+            sort_recs(buf, count);
+            int out_fd = open_run(runs, 1);
+            if (write_full(out_fd, buf, count * sizeof(struct rec)) == -1) {
+                perror("write run");
+                exit(1);
+            }
+            if (close(out_fd) == -1) {
+                perror("close");
+                exit(1);
+            }
+            exit(0);
+        }
+        running++;
+        runs++;
+    }
+    wait_children(running);
+    free(buf);
+    merge_all_runs(runs, outfile, block, fan_in);
+}
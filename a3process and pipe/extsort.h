@@ -0,0 +1,18 @@
+#ifndef _EXTSORT_H
+#define _EXTSORT_H
+
+#include <stddef.h>
+
+/* Number of bytes read or written at a time while merging runs. */
+#define MERGE_BLOCK (1 << 20)
+
+/* Most runs merged at once, to stay within the open file limit. */
+#define MAX_FAN_IN 256
+
+/* Number of records in each chunk of stream_sort when there is no budget. */
+#define STREAM_CHUNK (1 << 18)
+
+void external_sort(char *infile, char *outfile, int n, long sum, size_t budget);
+void stream_sort(int in_fd, char *outfile, int n, size_t budget);
+
+#endif /* _EXTSORT_H */
@@ -1,11 +1,18 @@
+#define _GNU_SOURCE
+#include <sched.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/wait.h>
 #include "helper.h"
 
 
-int get_file_size(char *filename) {
+off_t get_file_size(char *filename) {
     struct stat sbuf;
 
     if ((stat(filename, &sbuf)) == -1) {
@@ -16,17 +23,280 @@ int get_file_size(char *filename) {
     return sbuf.st_size;
 }
 
+int sort_key = 0;
+
 /* A comparison function to use for qsort */
 int compare_freq(const void *rec1, const void *rec2) {
+    return rec_cmp_freq(rec1, rec2);
+}
 
-    struct rec *r1 = (struct rec *) rec1;
-    struct rec *r2 = (struct rec *) rec2;
+/* Return the sort key named by str: "freq" or "-freq" for lowest or
+ * highest freq first, and ",word" after it to break ties by word.
+ * Return -1 if str names no key.
+ */
+int parse_sort_key(char *str) {
+    int key = 0;
 
-    if (r1->freq == r2->freq) {
-        return 0;
-    } else if (r1->freq > r2->freq) {
-        return 1;
-    } else {
+    if (*str == '-') {
+        key |= KEY_DESC;
+        str++;
+    }
+    if (strcmp(str, "freq,word") == 0) {
+        key |= KEY_WORD;
+    } else if (strcmp(str, "freq") != 0) {
         return -1;
     }
+    return key;
+}
+
+/* Sort by key from now on, in this process and the children it forks. */
+void set_sort_key(int key) {
+    sort_key = key;
+}
+
+/* Write all size bytes of buf to fd, continuing after partial writes.
+ * Return 0 on success and -1 on error, with errno set.
+ */
+int write_full(int fd, const void *buf, size_t size) {
+    const char *p = buf;
+
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += written;
+        size -= written;
+    }
+    return 0;
+}
+
+/* Write all size bytes of buf at offset of fd, as write_full does. */
+int pwrite_full(int fd, const void *buf, size_t size, off_t offset) {
+    const char *p = buf;
+
+    while (size > 0) {
+        ssize_t written = pwrite(fd, p, size, offset);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += written;
+        size -= written;
+        offset += written;
+    }
+    return 0;
+}
+
+/* Set up reader to read records from fd, cap records at a time. */
+void init_rec_reader(struct rec_reader *reader, int fd, int cap) {
+    reader->fd = fd;
+    reader->pos = 0;
+    reader->count = 0;
+    reader->extra = 0;
+    reader->cap = cap;
+    if ((reader->buf = malloc(cap * sizeof(struct rec))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+}
+
+// refill the buffer of reader with at least one whole record;
+// return the number of records, or 0 at the end of the pipe
+static int refill(struct rec_reader *reader) {
+    char *bytes = (char *) reader->buf;
+    size_t have = reader->extra;
+
+    // keep the partial record from the last read
+    memmove(bytes, bytes + reader->count * sizeof(struct rec), have);
+    reader->pos = 0;
+    reader->count = 0;
+    while (have < sizeof(struct rec)) {
+        ssize_t got = read(reader->fd, bytes + have,
+                           reader->cap * sizeof(struct rec) - have);
+        if (got == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            exit(1);
+        }
+        if (got == 0) {
+            if (have > 0) {
+                fprintf(stderr, "Error: partial record at end of pipe\n");
+                exit(1);
+            }
+            reader->extra = 0;
+            return 0;
+        }
+        have += got;
+    }
+    reader->count = have / sizeof(struct rec);
+    reader->extra = have % sizeof(struct rec);
+    return reader->count;
+}
+
+/* Return a pointer to the next record from reader, or NULL if there are
+ * no more records. The record stays valid until the next call.
+ */
+struct rec *next_rec(struct rec_reader *reader) {
+    if (reader->pos == reader->count && refill(reader) == 0) {
+        return NULL;
+    }
+    return &reader->buf[reader->pos++];
+}
+
+void free_rec_reader(struct rec_reader *reader) {
+    free(reader->buf);
+}
+
+/* Read size bytes at offset of the file open on fd into buf, READ_BLOCK
+ * bytes at a time. The kernel is told the range is read in order, and
+ * asked to fetch each block while the one before it is copied.
+ */
+void read_range(int fd, void *buf, size_t size, off_t offset) {
+    char *p = buf;
+
+    // these are only hints, so a failure is not an error
+    posix_fadvise(fd, offset, size, POSIX_FADV_SEQUENTIAL);
+    while (size > 0) {
+        size_t want = size < READ_BLOCK ? size : READ_BLOCK;
+        if (size > want) {
+            posix_fadvise(fd, offset + want, size - want < READ_BLOCK ?
+                          size - want : READ_BLOCK, POSIX_FADV_WILLNEED);
+        }
+        ssize_t got = pread(fd, p, want, offset);
+        if (got == -1 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            fprintf(stderr, "Error: could not read input file\n");
+            exit(1);
+        }
+        p += got;
+        size -= got;
+        offset += got;
+    }
+}
+
+/* Read records [start, start + count) of the file open on fd into buf. */
+void read_recs(int fd, struct rec *buf, long start, long count) {
+    read_range(fd, buf, (size_t) count * sizeof(struct rec),
+               (off_t) start * sizeof(struct rec));
+}
+
+/* Return the time in milliseconds from some fixed point. */
+double now_msec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// the CPUs children are pinned to by pin_child, and how many there are
+static int child_cpus[CPU_SETSIZE];
+static int num_child_cpus = 0;
+
+/* Choose the number of processes for -n auto from the CPUs this process
+ * may run on and from records, the number of input records, or -1 if it
+ * is not known. One CPU is kept for the parent's merge, and every child
+ * gets at least AUTO_MIN_RECS records, as a smaller slice is not worth a
+ * fork. The parent is pinned to its CPU here, and children pin themselves
+ * to the others with pin_child. The choices are printed to stderr.
+ */
+int auto_procs(long records) {
+    cpu_set_t mask;
+    int cpus[CPU_SETSIZE];
+    int num_cpus = 0;
+    int n;
+
+    if (sched_getaffinity(0, sizeof(mask), &mask) == -1) {
+        perror("sched_getaffinity");
+        exit(1);
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &mask)) {
+            cpus[num_cpus++] = cpu;
+        }
+    }
+    // with one CPU, the parent and the child share it
+    for (int i = num_cpus > 1 ? 1 : 0; i < num_cpus; i++) {
+        child_cpus[num_child_cpus++] = cpus[i];
+    }
+    n = num_child_cpus;
+    if (records >= 0 && records / AUTO_MIN_RECS < n) {
+        n = records / AUTO_MIN_RECS > 0 ? records / AUTO_MIN_RECS : 1;
+    }
+
+    CPU_ZERO(&mask);
+    CPU_SET(cpus[0], &mask);
+    if (sched_setaffinity(0, sizeof(mask), &mask) == -1) {
+        perror("sched_setaffinity");
+        exit(1);
+    }
+    fprintf(stderr, "psort: -n auto: %d CPUs available, %ld input records, "
+            "%d processes of at least %d records, parent on CPU %d, "
+            "children on CPUs %d to %d\n", num_cpus, records, n, AUTO_MIN_RECS,
+            cpus[0], child_cpus[0], child_cpus[num_child_cpus - 1]);
+    return n;
+}
+
+/* Pin the calling child or thread, the ith of its kind, to its own CPU if
+ * -n auto chose the number of processes. Otherwise do nothing.
+ */
+void pin_child(int i) {
+    cpu_set_t mask;
+
+    if (num_child_cpus == 0) {
+        return;
+    }
+    CPU_ZERO(&mask);
+    CPU_SET(child_cpus[i % num_child_cpus], &mask);
+    // a child that cannot be pinned still sorts correctly
+    sched_setaffinity(0, sizeof(mask), &mask);
+}
+
+//wait for n children and exit if any of them failed
+void wait_children(int n){
+    int status;
+    for (int t = 0; t < n; t++) {
+        if (wait(&status) == -1) {
+            perror("wait");
+            exit(1);
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Child terminated abnormally\n");
+            exit(1);
+        }
+    }
+}
+
+/* Return the number of bytes in str, a number with an optional K, M or G
+ * suffix, or 0 if str is not a valid size.
+ */
+size_t parse_size(char *str) {
+    char *end;
+    long long size = strtoll(str, &end, 10);
+
+    switch (*end) {
+    case 'G': case 'g':
+        size *= 1024;
+        // fall through
+    case 'M': case 'm':
+        size *= 1024;
+        // fall through
+    case 'K': case 'k':
+        size *= 1024;
+        end++;
+        break;
+    }
+    if (*end != '\0' || size <= 0) {
+        return 0;
+    }
+    return size;
 }
@@ -1,6 +1,10 @@
 #ifndef _HELPER_H
 #define _HELPER_H
 
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+
 #define SIZE 44
 
 struct rec {
@@ -8,7 +12,98 @@ struct rec {
     char word[SIZE];
 };
 
-int get_file_size(char *filename);
+/* Bits of a sort key: sort by freq from highest to lowest instead of
+ * lowest to highest, and break ties in freq by word.
+ */
+#define KEY_DESC 1
+#define KEY_WORD 2
+
+/* A function inlined wherever it is called, such as into each case of
+ * the KEY_SWITCH that calls it, even when the build does not optimize.
+ */
+#define PER_KEY static inline __attribute__((always_inline))
+
+/* Define name as an inline comparison of two records for one sort key, so
+ * that each key gets code of its own with no tests of the key at run time.
+ */
+#define DEFINE_REC_COMPARE(name, desc, by_word)                           \
+PER_KEY int name(const struct rec *r1, const struct rec *r2) {            \
+    if (r1->freq != r2->freq) {                                           \
+        return (r1->freq > r2->freq) != (desc) ? 1 : -1;                  \
+    }                                                                     \
+    return (by_word) ? strncmp(r1->word, r2->word, SIZE) : 0;             \
+}
+
+DEFINE_REC_COMPARE(rec_cmp_freq, 0, 0)
+DEFINE_REC_COMPARE(rec_cmp_freq_desc, 1, 0)
+DEFINE_REC_COMPARE(rec_cmp_freq_word, 0, 1)
+DEFINE_REC_COMPARE(rec_cmp_freq_desc_word, 1, 1)
+
+/* Compare r1 and r2 by sort key key. Loops that compare take the key as
+ * a constant from KEY_SWITCH, so that this switch is folded away and the
+ * comparison for that key alone is inlined.
+ */
+PER_KEY int rec_compare(int key, const struct rec *r1, const struct rec *r2) {
+    switch (key) {
+    case KEY_DESC:
+        return rec_cmp_freq_desc(r1, r2);
+    case KEY_WORD:
+        return rec_cmp_freq_word(r1, r2);
+    case KEY_DESC | KEY_WORD:
+        return rec_cmp_freq_desc_word(r1, r2);
+    default:
+        return rec_cmp_freq(r1, r2);
+    }
+}
+
+/* Run stmt for sort key key, with K in stmt naming the key as a constant.
+ * A PER_KEY function called this way is compiled once for each key.
+ */
+#define KEY_SWITCH(key, stmt)                                             \
+    switch (key) {                                                        \
+    case KEY_DESC: { enum { K = KEY_DESC }; stmt; break; }                \
+    case KEY_WORD: { enum { K = KEY_WORD }; stmt; break; }                \
+    case KEY_DESC | KEY_WORD: { enum { K = KEY_DESC | KEY_WORD }; stmt; break; } \
+    default: { enum { K = 0 }; stmt; break; }                             \
+    }
+
+/* The sort key chosen with set_sort_key. */
+extern int sort_key;
+
+/* Number of bytes moved by one read from a pipe. */
+#define PIPE_BLOCK 65536
+
+/* Number of bytes a child reads from the input file at a time. */
+#define READ_BLOCK (1 << 20)
+
+/* Fewest records -n auto gives each child. */
+#define AUTO_MIN_RECS (1 << 16)
+
+/* Buffered reader of the records coming down a pipe. */
+struct rec_reader {
+    int fd;
+    struct rec *buf;    // records read from fd but not handed out yet
+    int pos;            // index in buf of the next record to hand out
+    int count;          // number of whole records in buf
+    int extra;          // bytes of a partial record after the whole ones
+    int cap;            // number of records buf has room for
+};
+
+off_t get_file_size(char *filename);
 int compare_freq(const void *rec1, const void *rec2);
+int parse_sort_key(char *str);
+void set_sort_key(int key);
+int write_full(int fd, const void *buf, size_t size);
+int pwrite_full(int fd, const void *buf, size_t size, off_t offset);
+void init_rec_reader(struct rec_reader *reader, int fd, int cap);
+struct rec *next_rec(struct rec_reader *reader);
+void free_rec_reader(struct rec_reader *reader);
+void read_range(int fd, void *buf, size_t size, off_t offset);
+void read_recs(int fd, struct rec *buf, long start, long count);
+double now_msec(void);
+int auto_procs(long records);
+void pin_child(int i);
+void wait_children(int n);
+size_t parse_size(char *str);
 
 #endif /* _HELPER_H */
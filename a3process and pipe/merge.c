@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "merge.h"
+
+// return non-zero if run a's head must come out before run b's
+PER_KEY int before(struct merge_heap *heap, int a, int b, const int key) {
+    int cmp = rec_compare(key, heap->heads[a], heap->heads[b]);
+    return cmp < 0 || (cmp == 0 && a < b);
+}
+
+// move the run at position i down until the heap is in order again
+PER_KEY void sift_down_key(struct merge_heap *heap, int i, const int key) {
+    int run = heap->runs[i];
+    while (2 * i + 1 < heap->size) {
+        int child = 2 * i + 1;
+        if (child + 1 < heap->size &&
+            before(heap, heap->runs[child + 1], heap->runs[child], key)) {
+            child++;
+        }
+        if (!before(heap, heap->runs[child], run, key)) {
+            break;
+        }
+        heap->runs[i] = heap->runs[child];
+        i = child;
+    }
+    heap->runs[i] = run;
+}
+
+static void sift_down(struct merge_heap *heap, int i) {
+    KEY_SWITCH(heap->key, sift_down_key(heap, i, K));
+}
+
+PER_KEY void push_key(struct merge_heap *heap, int run, const int key) {
+    int i = heap->size++;
+    while (i > 0 && before(heap, run, heap->runs[(i - 1) / 2], key)) {
+        heap->runs[i] = heap->runs[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->runs[i] = run;
+}
+
+/* Start an empty heap over heads, ordered by sort key key. runs must have
+ * room for one index per run that will be pushed.
+ */
+void init_merge_heap(struct merge_heap *heap, struct rec **heads, int *runs, int key) {
+    heap->runs = runs;
+    heap->heads = heads;
+    heap->size = 0;
+    heap->key = key;
+}
+
+// add a run whose head has been filled in
+void heap_push(struct merge_heap *heap, int run) {
+    KEY_SWITCH(heap->key, push_key(heap, run, K));
+}
+
+// the head of the top run was replaced by its next record
+void heap_sift_top(struct merge_heap *heap) {
+    sift_down(heap, 0);
+}
+
+// the top run has no more records
+void heap_pop(struct merge_heap *heap) {
+    heap->size--;
+    if (heap->size > 0) {
+        heap->runs[0] = heap->runs[heap->size];
+        sift_down(heap, 0);
+    }
+}
+
+/* Return the number of records of all k runs that come before x, which is
+ * record pos of run of, in the merged order.
+ */
+PER_KEY long rank_of(struct rec **runs, long *lens, int k, int of, long pos,
+                     const int key) {
+    struct rec *x = &runs[of][pos];
+    long rank = pos;
+
+    for (int i = 0; i < k; i++) {
+        if (i == of) {
+            continue;
+        }
+        // runs before of also put their equal records before x
+        long lo = 0, hi = lens[i];
+        while (lo < hi) {
+            long mid = lo + (hi - lo) / 2;
+            int cmp = rec_compare(key, &runs[i][mid], x);
+            if (cmp < 0 || (cmp == 0 && i < of)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        rank += lo;
+    }
+    return rank;
+}
+
+/* Co-rank: split the k sorted runs so that the first rank records of their
+ * merge are exactly split[i] records from the front of each run i.
+ * Records that compare equal are split in run order, as the heap does.
+ */
+PER_KEY void corank_key(struct rec **runs, long *lens, int k, long rank, long *split,
+                       const int key) {
+    for (int i = 0; i < k; i++) {
+        // the records of run i with a rank below rank form a prefix
+        long lo = 0, hi = lens[i];
+        while (lo < hi) {
+            long mid = lo + (hi - lo) / 2;
+            if (rank_of(runs, lens, k, i, mid, key) < rank) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        split[i] = lo;
+    }
+}
+
+void corank(struct rec **runs, long *lens, int k, long rank, long *split, int key) {
+    KEY_SWITCH(key, corank_key(runs, lens, k, rank, split, K));
+}
+
+/* Merge the records [from[i], to[i]) of each run i and write them at
+ * record offset first of fd.
+ */
+static void merge_range(struct rec **runs, long *from, long *to, int k,
+                        int fd, long first, int key) {
+    long block = WRITE_BLOCK / sizeof(struct rec);
+    struct rec *heads[k];
+    int heap_runs[k];
+    struct merge_heap heap;
+    struct rec *out;
+    long used = 0;
+
+    if ((out = malloc(block * sizeof(struct rec))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    init_merge_heap(&heap, heads, heap_runs, key);
+    for (int i = 0; i < k; i++) {
+        if (from[i] < to[i]) {
+            heads[i] = &runs[i][from[i]];
+            heap_push(&heap, i);
+        }
+    }
+    while (heap.size > 0) {
+        int top = heap_top(&heap);
+        out[used++] = *heads[top];
+        if (used == block) {
+            if (pwrite_full(fd, out, used * sizeof(struct rec),
+                            (off_t) first * sizeof(struct rec)) == -1) {
+                perror("pwrite");
+                exit(1);
+            }
+            first += used;
+            used = 0;
+        }
+        if (++heads[top] == &runs[top][to[top]]) {
+            heap_pop(&heap);
+        } else {
+            heap_sift_top(&heap);
+        }
+    }
+    if (pwrite_full(fd, out, used * sizeof(struct rec),
+                    (off_t) first * sizeof(struct rec)) == -1) {
+        perror("pwrite");
+        exit(1);
+    }
+    free(out);
+}
+
+/* Merge the k sorted runs into fd with p processes. The output is cut into
+ * p ranges of equal size; each process finds where its range starts in
+ * every run with corank and writes its part of the merge at its own offset.
+ * The runs must be in memory the children share, such as a mapping.
+ */
+void parallel_merge(struct rec **runs, long *lens, int k, int fd, int p, int key) {
+    long sum = 0;
+
+    for (int i = 0; i < k; i++) {
+        sum += lens[i];
+    }
+    if (p > sum) {
+        p = sum > 0 ? sum : 1;
+    }
+    for (int j = 0; j < p; j++) {
+        int result = fork();
+        if (result < 0) {
+            perror("fork");
+            exit(1);
+        } else if (result == 0) {
+            pin_child(j);
+            long first = j * (sum / p) + (j < sum % p ? j : sum % p);
+            long last = first + sum / p + (j < sum % p ? 1 : 0);
+            long from[k], to[k];
+            corank(runs, lens, k, first, from, key);
+            corank(runs, lens, k, last, to, key);
+            merge_range(runs, from, to, k, fd, first, key);
+            exit(0);
+        }
+    }
+    wait_children(p);
+}
@@ -0,0 +1,32 @@
+#ifndef _MERGE_H
+#define _MERGE_H
+
+#include "helper.h"
+
+/* Number of bytes each process of parallel_merge writes at a time. */
+#define WRITE_BLOCK (1 << 20)
+
+/* A binary min-heap of runs, ordered by the next record of each run.
+ * heads[r] points to the next record of run r. Records that compare equal come
+ * out in run order, which is the order a linear scan of the runs gives.
+ */
+struct merge_heap {
+    int *runs;          // heap of run indices; runs[0] has the smallest head
+    struct rec **heads; // the next record of each run
+    int size;           // number of runs that still have records
+    int key;            // the sort key the records are ordered by
+};
+
+void init_merge_heap(struct merge_heap *heap, struct rec **heads, int *runs, int key);
+void heap_push(struct merge_heap *heap, int run);
+void heap_sift_top(struct merge_heap *heap);
+void heap_pop(struct merge_heap *heap);
+void corank(struct rec **runs, long *lens, int k, long rank, long *split, int key);
+void parallel_merge(struct rec **runs, long *lens, int k, int fd, int p, int key);
+
+/* Return the run whose head is the smallest record. */
+static inline int heap_top(struct merge_heap *heap) {
+    return heap->runs[0];
+}
+
+#endif /* _MERGE_H */
@@ -4,10 +4,39 @@
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include "helper.h"
+#include "compact.h"
 
 #define UPPER 30000
 
+/* Number of records made and written at a time with -N. */
+#define GEN_BLOCK 65536
+
+/* Most threads -N makes records with. */
+#define MAX_THREADS 256
+
+#define USAGE "Usage: mkwords [-c] -f <input file name> -o <output file name>\n" \
+              "       mkwords [-c] -N <records> [-f <input file name>] -o <output file name>\n" \
+              "               [-d uniform|zipf|equal|sorted|reverse] [-t <threads>] [-S <seed>]\n"
+
+/* How the frequencies of -N's records are spread over [0, UPPER]. */
+enum dist { UNIFORM, ZIPF, EQUAL, SORTED, REVERSE };
+
+/* What -N makes, shared by its threads. */
+struct gen {
+    long long total;        // number of records to make
+    enum dist dist;
+    char **words;           // words to choose from, or NULL for made up ones
+    long num_words;
+    uint64_t seed;
+    double *zipf_cdf;       // zipf_cdf[k] is the chance of a freq of at most k
+    int out_fd;             // file to pwrite blocks to, or -1 to keep them
+    long long next_block;   // the next block a thread should make
+};
+
 
 /*
  * Return a randomly generated number, uniformly distributed between
@@ -17,14 +46,215 @@ int uniform(int lower,int upper) {
     return (int) (floor ( drand48() * (upper - lower + 1) ) + lower);
 }
 
+// return the next number of the splitmix64 sequence with state *state
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* Fill recs with the count records of gen that start at record first.
+ * The random numbers of a block depend only on the seed and the block,
+ * so the output is the same for any number of threads.
+ */
+static void make_block(struct gen *gen, long long first, long count, struct rec *recs) {
+    uint64_t state = gen->seed ^ (first / GEN_BLOCK) * 0xD1B54A32D192ED03ULL;
+
+    for (long i = 0; i < count; i++) {
+        struct rec *r = &recs[i];
+        long long at = first + i;
+        uint64_t x = next_random(&state);
+
+        switch (gen->dist) {
+        case UNIFORM:
+            r->freq = x % (UPPER + 1);
+            break;
+        case ZIPF: {
+            double u = (x >> 11) * (1.0 / 9007199254740992.0);
+            int lo = 0, hi = UPPER;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (gen->zipf_cdf[mid] < u) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            r->freq = lo;
+            break;
+        }
+        case EQUAL:
+            r->freq = UPPER / 2;
+            break;
+        case SORTED:
+            r->freq = at * (UPPER + 1) / gen->total;
+            break;
+        case REVERSE:
+            r->freq = UPPER - at * (UPPER + 1) / gen->total;
+            break;
+        }
+        memset(r->word, '\0', SIZE);
+        x = next_random(&state);
+        if (gen->words) {
+            strncpy(r->word, gen->words[x % gen->num_words], SIZE - 1);
+        } else {
+            // a made up word of 3 to 10 lowercase letters
+            int len = 3 + x % 8;
+            for (int k = 0; k < len; k++) {
+                x /= 26;
+                if (x == 0) {
+                    x = next_random(&state);
+                }
+                r->word[k] = 'a' + x % 26;
+            }
+        }
+    }
+}
+
+// the body of each thread of -N: make blocks and pwrite them until done
+static void *make_blocks(void *arg) {
+    struct gen *gen = arg;
+    struct rec *recs = malloc(GEN_BLOCK * sizeof(struct rec));
+    long long block;
+
+    if (recs == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    while ((block = __atomic_fetch_add(&gen->next_block, 1, __ATOMIC_RELAXED)) *
+           GEN_BLOCK < gen->total) {
+        long long first = block * GEN_BLOCK;
+        long count = gen->total - first < GEN_BLOCK ? gen->total - first : GEN_BLOCK;
+        make_block(gen, first, count, recs);
+        if (pwrite_full(gen->out_fd, recs, count * sizeof(struct rec),
+                        (off_t) first * sizeof(struct rec)) == -1) {
+            perror("pwrite");
+            exit(1);
+        }
+    }
+    free(recs);
+    return NULL;
+}
+
+// read the words of infile, one per line, into gen
+static void read_word_list(struct gen *gen, char *infile) {
+    char word[SIZE];
+    long cap = 1024;
+    FILE *infp = fopen(infile, "r");
+
+    if (infp == NULL) {
+        fprintf(stderr, "Could not open %s\n", infile);
+        exit(1);
+    }
+    gen->num_words = 0;
+    if ((gen->words = malloc(cap * sizeof(char *))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    while (fgets(word, sizeof(word), infp) != NULL) {
+        word[strcspn(word, "\n")] = '\0';
+        if (gen->num_words == cap) {
+            cap *= 2;
+            if ((gen->words = realloc(gen->words, cap * sizeof(char *))) == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        if ((gen->words[gen->num_words++] = strdup(word)) == NULL) {
+            perror("strdup");
+            exit(1);
+        }
+    }
+    fclose(infp);
+    if (gen->num_words == 0) {
+        fprintf(stderr, "%s has no words\n", infile);
+        exit(1);
+    }
+}
+
+/* Write gen->total made up records to outfile with num_threads threads.
+ * Each thread takes the next GEN_BLOCK records and pwrites them at their
+ * place in the file. A compact file is written by this thread alone, as
+ * the place of a compact record depends on all the records before it.
+ */
+static void generate(struct gen *gen, char *outfile, int compact, int num_threads) {
+    pthread_t threads[MAX_THREADS];
+
+    if (gen->dist == ZIPF) {
+        // the chance of freq k is proportional to 1 / (k + 1)
+        if ((gen->zipf_cdf = malloc((UPPER + 1) * sizeof(double))) == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        double total = 0;
+        for (int k = 0; k <= UPPER; k++) {
+            total += 1.0 / (k + 1);
+            gen->zipf_cdf[k] = total;
+        }
+        for (int k = 0; k <= UPPER; k++) {
+            gen->zipf_cdf[k] /= total;
+        }
+    }
+    if ((gen->out_fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+        fprintf(stderr, "Could not open %s\n", outfile);
+        exit(1);
+    }
+
+    if (compact) {
+        struct compact_writer writer;
+        struct rec *recs = malloc(GEN_BLOCK * sizeof(struct rec));
+        if (recs == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        init_compact_writer(&writer, gen->out_fd, READ_BLOCK, gen->total);
+        for (long long first = 0; first < gen->total; first += GEN_BLOCK) {
+            long count = gen->total - first < GEN_BLOCK ? gen->total - first : GEN_BLOCK;
+            make_block(gen, first, count, recs);
+            for (long i = 0; i < count; i++) {
+                compact_write(&writer, &recs[i]);
+            }
+        }
+        finish_compact_writer(&writer);
+        free(recs);
+    } else {
+        gen->next_block = 0;
+        for (int i = 0; i < num_threads; i++) {
+            if (pthread_create(&threads[i], NULL, make_blocks, gen) != 0) {
+                perror("pthread_create");
+                exit(1);
+            }
+        }
+        for (int i = 0; i < num_threads; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    if (close(gen->out_fd) == -1) {
+        perror("close");
+        exit(1);
+    }
+    free(gen->zipf_cdf);
+}
+
 /* This program takes as input a file containing one word per line.  
  * It uses the each word together with a randomly generated frequency count 
  * to create a struct that is written to the output file.
  * The result is a binary file in the correct format to use as input to
  * psort.
  * 
+ * With -c the output is in the compact layout instead (see compact.h).
+ *
+ * With -N it instead makes the given number of records (with an optional
+ * K, M or G suffix, as powers of 1024), with words taken
+ * at random from the input file or made up if there is none, and
+ * frequencies spread as -d says: uniform, zipf (freq k about 1 / (k + 1)
+ * as likely as 0), equal, or sorted or reverse (rising or falling through
+ * the records). -t sets the number of threads, and -S seeds the random
+ * numbers so that the same options make the same file.
+ *
  * To compile the program the math library must be linked:
- *          gcc -Wall -g -std=gnu99 -o mkwords mkwords.c -lm
+ *          gcc -Wall -g -std=gnu99 -o mkwords mkwords.c compact.c helper.c -lm
  */
 
 int main(int argc, char *argv[]) {
@@ -33,15 +263,49 @@ int main(int argc, char *argv[]) {
     FILE *infp, *outfp;
     struct rec record;
     char *infile = NULL, *outfile = NULL;
-
-    if (argc != 5) {
-        fprintf(stderr, "Usage: mkwords -f <input file name> -o <output file name>\n");
-        exit(1);
-    }
+    int compact = 0;
+    struct compact_writer writer;
+    struct gen gen = {0, UNIFORM, NULL, 0, time(NULL), NULL, -1, 0};
+    int num_threads = 1;
 
     /* read in arguments */
-    while ((ch = getopt(argc, argv, "f:o:")) != -1) {
+    while ((ch = getopt(argc, argv, "cf:o:N:d:t:S:")) != -1) {
         switch(ch) {
+        case 'c':
+            compact = 1;
+            break;
+        case 'N':
+            if ((gen.total = parse_size(optarg)) == 0) {
+                fprintf(stderr, USAGE);
+                exit(1);
+            }
+            break;
+        case 'd':
+            if (strcmp(optarg, "uniform") == 0) {
+                gen.dist = UNIFORM;
+            } else if (strcmp(optarg, "zipf") == 0) {
+                gen.dist = ZIPF;
+            } else if (strcmp(optarg, "equal") == 0) {
+                gen.dist = EQUAL;
+            } else if (strcmp(optarg, "sorted") == 0) {
+                gen.dist = SORTED;
+            } else if (strcmp(optarg, "reverse") == 0) {
+                gen.dist = REVERSE;
+            } else {
+                fprintf(stderr, USAGE);
+                exit(1);
+            }
+            break;
+        case 't':
+            num_threads = strtol(optarg, NULL, 10);
+            if (num_threads < 1 || num_threads > MAX_THREADS) {
+                fprintf(stderr, USAGE);
+                exit(1);
+            }
+            break;
+        case 'S':
+            gen.seed = strtoull(optarg, NULL, 10);
+            break;
         case 'f':
             infile = optarg;
             break;
@@ -49,10 +313,21 @@ int main(int argc, char *argv[]) {
             outfile = optarg;
             break;
         default:
-            fprintf(stderr, "Usage: mkwords -f <input file name> -o <output file name>\n");
+            fprintf(stderr, USAGE);
             exit(1);
         }
     }
+    if (outfile == NULL || optind < argc || (infile == NULL && gen.total == 0)) {
+        fprintf(stderr, USAGE);
+        exit(1);
+    }
+    if (gen.total > 0) {
+        if (infile) {
+            read_word_list(&gen, infile);
+        }
+        generate(&gen, outfile, compact, num_threads);
+        return 0;
+    }
 
     /* seed the random number generator */
     
@@ -67,6 +342,16 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
+    /* a compact file's index depends on the number of words, so count them */
+    if (compact) {
+        long count = 0;
+        while ((fgets(record.word, sizeof(record.word), infp)) != NULL) {
+            count++;
+        }
+        rewind(infp);
+        init_compact_writer(&writer, fileno(outfp), READ_BLOCK, count);
+    }
+
     /* read a word from the input file, and make up a frequency for it */
 	/* Expects the input file to have one word per line */
     while ((fgets(record.word, sizeof(record.word), infp)) != NULL) {
@@ -74,10 +359,15 @@ int main(int argc, char *argv[]) {
         record.word[strlen(record.word) - 1] = '\0';
         record.freq = uniform(0, UPPER);
 
-        if ((fwrite(&record, sizeof(record), 1, outfp)) != 1) {
+        if (compact) {
+            compact_write(&writer, &record);
+        } else if ((fwrite(&record, sizeof(record), 1, outfp)) != 1) {
             fprintf(stderr, "Could not write to %s\n", outfile);
         }
     }
+    if (compact) {
+        finish_compact_writer(&writer);
+    }
 
     /* Close both files. */
     if (fclose(infp)) {
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "helper.h"
+
+#define USAGE "Usage: psbench [-p <psort>] [-g <mkwords>] [-n <processes,...>] " \
+              "[-N <records,...>] [-d <distribution,...>] [-e <engine>] [-r <runs>] " \
+              "[-T <directory>] [-o <csv file>]\n"
+
+/* Most values in one list option. */
+#define MAX_LIST 32
+
+/* The phase times of one psort run, from its "timing:" lines. Child phases
+ * are the longest over the children, as the parent waits for the slowest.
+ */
+struct phases {
+    double read;
+    double sort;
+    double send;
+    double merge;
+    double write;
+};
+
+/* This program measures psort. For each number of records and frequency
+ * distribution it makes an input file with mkwords -N, and sorts it with
+ * psort -t for each number of processes, runs times over. Each run is one
+ * line of CSV: wall time, throughput, the time of each phase psort reports
+ * and the peak resident set size of psort and its children.
+ * Phase columns are empty for engines that do not report them.
+ */
+
+// split the comma separated list str into at most MAX_LIST items
+static int split_list(char *str, char **items) {
+    int count = 0;
+
+    for (char *item = strtok(str, ","); item; item = strtok(NULL, ",")) {
+        if (count == MAX_LIST) {
+            fprintf(stderr, "Error: more than %d items in a list\n", MAX_LIST);
+            exit(1);
+        }
+        items[count++] = item;
+    }
+    return count;
+}
+
+/* Run argv with its stderr read into err (of size err_size), wait for it
+ * with wait4, and return its exit status. Store its wall time in wall_ms
+ * and its peak resident set size in rss_kb.
+ */
+static int run(char **argv, char *err, size_t err_size, double *wall_ms, long *rss_kb) {
+    int err_pipe[2];
+    struct rusage usage;
+    size_t used = 0;
+    ssize_t got;
+    int status;
+    double started = now_msec();
+
+    if (pipe(err_pipe) == -1) {
+        perror("pipe");
+        exit(1);
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    } else if (pid == 0) {
+        if (dup2(err_pipe[1], STDERR_FILENO) == -1) {
+            perror("dup2");
+            exit(1);
+        }
+        close(err_pipe[0]);
+        close(err_pipe[1]);
+        execv(argv[0], argv);
+        perror(argv[0]);
+        exit(1);
+    }
+    close(err_pipe[1]);
+    while ((got = read(err_pipe[0], err + used, err_size - 1 - used)) > 0) {
+        used += got;
+    }
+    err[used] = '\0';
+    close(err_pipe[0]);
+    if (wait4(pid, &status, 0, &usage) == -1) {
+        perror("wait4");
+        exit(1);
+    }
+    *wall_ms = now_msec() - started;
+    // for wait4, ru_maxrss covers the children psort waited for too
+    *rss_kb = usage.ru_maxrss;
+    return status;
+}
+
+// read the phase times out of psort's timing lines; return 0 if none
+static int parse_phases(char *err, struct phases *p) {
+    double read, sort, send, merge, write;
+    int found = 0;
+
+    memset(p, 0, sizeof(*p));
+    for (char *line = strtok(err, "\n"); line; line = strtok(NULL, "\n")) {
+        if (sscanf(line, "timing: child %*d records %*d read %lf sort %lf send %lf",
+                   &read, &sort, &send) == 3) {
+            p->read = read > p->read ? read : p->read;
+            p->sort = sort > p->sort ? sort : p->sort;
+            p->send = send > p->send ? send : p->send;
+            found = 1;
+        } else if (sscanf(line, "timing: parent records %*d merge %lf write %lf",
+                          &merge, &write) == 2) {
+            p->merge = merge;
+            p->write = write;
+            found = 1;
+        } else {
+            fprintf(stderr, "psort: %s\n", line);
+        }
+    }
+    return found;
+}
+
+int main(int argc, char *argv[]) {
+    char *psort = "./psort", *mkwords = "./mkwords", *engine = "pipe";
+    char procs_arg[] = "1,2,4,8", sizes_arg[] = "1M", dists_arg[] = "uniform";
+    char *procs_str = procs_arg, *sizes_str = sizes_arg, *dists_str = dists_arg;
+    char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    char *csv = NULL;
+    char *procs[MAX_LIST], *sizes[MAX_LIST], *dists[MAX_LIST];
+    int runs = 3;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:g:n:N:d:e:r:T:o:")) != -1) {
+        switch (opt) {
+        case 'p':
+            psort = optarg;
+            break;
+        case 'g':
+            mkwords = optarg;
+            break;
+        case 'n':
+            procs_str = optarg;
+            break;
+        case 'N':
+            sizes_str = optarg;
+            break;
+        case 'd':
+            dists_str = optarg;
+            break;
+        case 'e':
+            engine = optarg;
+            break;
+        case 'r':
+            if ((runs = strtol(optarg, NULL, 10)) < 1) {
+                fprintf(stderr, USAGE);
+                exit(1);
+            }
+            break;
+        case 'T':
+            dir = optarg;
+            break;
+        case 'o':
+            csv = optarg;
+            break;
+        default:
+            fprintf(stderr, USAGE);
+            exit(1);
+        }
+    }
+    if (optind < argc) {
+        fprintf(stderr, USAGE);
+        exit(1);
+    }
+    int num_procs = split_list(procs_str, procs);
+    int num_sizes = split_list(sizes_str, sizes);
+    int num_dists = split_list(dists_str, dists);
+
+    FILE *out = csv ? fopen(csv, "w") : stdout;
+    if (out == NULL) {
+        perror(csv);
+        exit(1);
+    }
+    char infile[4096], outfile[4096];
+    snprintf(infile, sizeof(infile), "%s/psbench-%d.in", dir, getpid());
+    snprintf(outfile, sizeof(outfile), "%s/psbench-%d.out", dir, getpid());
+    char err[1 << 16];
+
+    fprintf(out, "engine,records,distribution,processes,run,wall_ms,records_per_s,"
+                 "mb_per_s,child_read_ms,child_sort_ms,pipe_send_ms,parent_merge_ms,"
+                 "output_write_ms,peak_rss_kb\n");
+    for (int s = 0; s < num_sizes; s++) {
+        for (int d = 0; d < num_dists; d++) {
+            char *gen_argv[] = {mkwords, "-N", sizes[s], "-d", dists[d], "-S", "1",
+                                "-t", "4", "-o", infile, NULL};
+            double wall_ms;
+            long rss_kb;
+            if (run(gen_argv, err, sizeof(err), &wall_ms, &rss_kb) != 0) {
+                fprintf(stderr, "Error: mkwords failed: %s", err);
+                exit(1);
+            }
+            long records = get_file_size(infile) / sizeof(struct rec);
+
+            for (int p = 0; p < num_procs; p++) {
+                for (int r = 1; r <= runs; r++) {
+                    char *sort_argv[] = {psort, "-n", procs[p], "-f", infile, "-o", outfile,
+                                         "-e", engine, "-t", NULL};
+                    struct phases ph;
+                    if (run(sort_argv, err, sizeof(err), &wall_ms, &rss_kb) != 0) {
+                        fprintf(stderr, "Error: psort failed: %s", err);
+                        exit(1);
+                    }
+                    fprintf(out, "%s,%ld,%s,%s,%d,%.3f,%.0f,%.2f,", engine, records,
+                            dists[d], procs[p], r, wall_ms, records / (wall_ms / 1000),
+                            records * sizeof(struct rec) / 1e6 / (wall_ms / 1000));
+                    if (parse_phases(err, &ph)) {
+                        fprintf(out, "%.3f,%.3f,%.3f,%.3f,%.3f,", ph.read, ph.sort,
+                                ph.send, ph.merge, ph.write);
+                    } else {
+                        fprintf(out, ",,,,,");
+                    }
+                    fprintf(out, "%ld\n", rss_kb);
+                    fflush(out);
+                }
+            }
+        }
+    }
+    unlink(infile);
+    unlink(outfile);
+    if (csv && fclose(out) != 0) {
+        perror("fclose");
+        exit(1);
+    }
+    return 0;
+}
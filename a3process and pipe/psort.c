@@ -4,86 +4,256 @@
 #include <stdlib.h>
 #include <sys/wait.h>
 #include "helper.h"
+#include "merge.h"
+#include "extsort.h"
+#include "recsort.h"
+#include "tsort.h"
+#include "samplesort.h"
+#include "topk.h"
+#include "compact.h"
+#include "append.h"
 #include <getopt.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 
-//the merge function for the parent process
-int merge(struct rec* min_list, FILE* f2, int n){
-       int flag = 0;
-       //the index of the list who need to add a new one into
-       int add = 0;
-       struct rec min;
-       for(int k = 0; k < n; k++){
-            if(min_list[k].freq != -2){
-                if(flag == 0){
-                    min = min_list[k];
-                    add = k;
-                    flag = 1;
-                }else if(min.freq > min_list[k].freq){
-                    min = min_list[k];
-                    add = k;
-                }
-            }
-        }
-        //write the rec into the output file
-        if (fwrite(&min, sizeof(struct rec),1,f2) != 1){
-             fprintf(stderr, "Error: data not fully written to file\n");
-             exit(1);
-        }
+#define USAGE "Usage: psort -n <number of processes>|auto -f <inputfile>|- -o <outputfile> [-e pipe|shm|thread|sample] [-m <memory budget>] [-k <count> [-r]] [-s [-]freq[,word]] [-a <sorted file> [-x <index file>]] [-t]\n"
+
+//the merge function for the parent process:
+//copy the smallest head to out and return its run
+int merge(struct merge_heap *heap, struct rec *out){
+        int add = heap_top(heap);
+        *out = *heap->heads[add];
         return add;
 }
 
+//with -t, each phase of the pipe engine is timed and printed to stderr
+//as "timing: ..." lines, in milliseconds
+int timing = 0;
+//how long this child took to read its slice and to sort it
+double read_ms = 0, sort_ms = 0;
+
 //the sort function for child process
-struct rec* sort(char* infile, int current,int whether){
+struct rec* sort(char* infile, long current,long whether){
     struct rec* compare_list;
     if((compare_list= malloc(whether*sizeof(struct rec))) == NULL){
         perror("malloc");
         exit(1);
     }
-    FILE* f1 = fopen(infile, "rb");
-    if (f1 == NULL) {
-        perror("fopen\n");
+    int fd = open(infile, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        exit(1);
+    }
+    //read the part this child need to read, in large blocks
+    double started = now_msec();
+    read_recs(fd, compare_list, current, whether);
+    double read_done = now_msec();
+    //sort array by counting sort, or by keys for wide key ranges
+    sort_recs(compare_list, whether);
+    read_ms = read_done - started;
+    sort_ms = now_msec() - read_done;
+    //close the input file
+    if(close(fd) == -1){
+        perror("close");
+        exit(1);
+    }
+    return compare_list;
+}
+
+//the shared memory engine: each child sorts its slice of the mapped
+//input file inside one shared region, then n children merge the slices
+//from that region, each writing its own part of the output file
+void shm_sort(char *infile, char *outfile, int n, long sum){
+    size_t size = (size_t)sum * sizeof(struct rec);
+    //start[i] is the first element of child i, split as the pipe engine does
+    long start[n + 1];
+    struct rec *runs = sort_shared(infile, n, sum, start);
+
+    int fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("open");
+        exit(1);
+    }
+    //the children merge equal parts of the output at the same time
+    struct rec *slices[n];
+    long lens[n];
+    for(int i = 0; i < n; i++){
+        slices[i] = runs + start[i];
+        lens[i] = start[i + 1] - start[i];
+    }
+    parallel_merge(slices, lens, n, fd, n, sort_key);
+
+    if (munmap(runs, size) == -1) {
+        perror("munmap");
+        exit(1);
+    }
+    if (close(fd) == -1) {
+        perror("close");
         exit(1);
     }
-    fseek(f1, (current)*sizeof(struct rec), SEEK_SET);              
-    //read the part this child need to read
-    for(int i = 0; i < whether; i++){
-        if(fread(&compare_list[i], sizeof(struct rec),1 ,f1)==0){
-            fprintf(stderr,"fread failed\n");
+}
+
+
+//the compact engine, for input in the compact format: each child decodes
+//and sorts a slice that starts at an index entry, and sends it down its
+//pipe still compact; the parent merges the pipes into a compact file
+void compact_sort(char *infile, char *outfile, int n){
+    struct compact_header header;
+    int fd = open(infile, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        exit(1);
+    }
+    uint64_t *index = read_compact_header(fd, &header);
+    long sum = header.count;
+    long entries = header.index_size;
+    index[entries] = get_file_size(infile);
+    if(n > entries){
+        n = entries;
+    }
+    int out_fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd == -1) {
+        perror("open");
+        exit(1);
+    }
+    struct compact_writer writer;
+    init_compact_writer(&writer, out_fd, PIPE_BLOCK, sum);
+    if(n == 0){
+        finish_compact_writer(&writer);
+        close(out_fd);
+        return;
+    }
+
+    int pipe_fd[n][2];
+    for(int i = 0; i < n; i++){
+        //child i gets index entries [first, last)
+        long first = i * (entries / n) + (i < entries % n ? i : entries % n);
+        long last = first + entries / n + (i < entries % n ? 1 : 0);
+        if (pipe(pipe_fd[i]) == -1) {
+            perror("pipe");
+            exit(1);
+        }
+        int result = fork();
+        if (result < 0) {
+            perror("fork");
+            exit(1);
+        }else if(result == 0){
+            pin_child(i);
+            for(int j = 0; j <= i; j++){
+                if (close(pipe_fd[j][0]) == -1) {
+                    perror("close reading end");
+                    exit(1);
+                }
+            }
+            long start = first * header.stride;
+            long whether = (last * header.stride < sum ? last * header.stride : sum) - start;
+            size_t bytes = index[last] - index[first];
+            char *raw = malloc(bytes);
+            struct rec *compare_list = malloc(whether * sizeof(struct rec));
+            if (raw == NULL || compare_list == NULL) {
+                perror("malloc");
+                exit(1);
+            }
+            read_range(fd, raw, bytes, index[first]);
+            size_t pos = 0;
+            for(long k = 0; k < whether; k++){
+                size_t used = decode_rec(raw + pos, bytes - pos, &compare_list[k]);
+                if(used == 0){
+                    fprintf(stderr, "Error: compact records end in the middle\n");
+                    exit(1);
+                }
+                pos += used;
+            }
+            sort_recs(compare_list, whether);
+            //the sorted records take as many bytes as they did unsorted
+            pos = 0;
+            for(long k = 0; k < whether; k++){
+                pos += encode_rec(raw + pos, &compare_list[k]);
+            }
+            if (write_full(pipe_fd[i][1], raw, pos) == -1) {
+                perror("write from child to pipe");
+                exit(1);
+            }
+            if (close(pipe_fd[i][1]) == -1) {
+                perror("close pipe after writing");
+                exit(1);
+            }
+            exit(0);
+        }
+        if (close(pipe_fd[i][1]) == -1) {
+            perror("close writing end of pipe in parent");
             exit(1);
         }
     }
-    //sort array using qsort functions
-    qsort(compare_list, whether, sizeof(struct rec), compare_freq);
-    //close the input file
-    if(fclose(f1) != 0){
-        perror("fclose\n");
+
+    struct rec *heads[n];
+    int heap_runs[n];
+    struct merge_heap heap;
+    struct compact_reader readers[n];
+    init_merge_heap(&heap, heads, heap_runs, sort_key);
+    for(int i = 0; i < n; i++){
+        init_compact_reader(&readers[i], pipe_fd[i][0], PIPE_BLOCK, -1);
+        if((heads[i] = next_compact(&readers[i])) != NULL){
+            heap_push(&heap, i);
+        }
+    }
+    while(heap.size > 0){
+        int add = heap_top(&heap);
+        compact_write(&writer, heads[add]);
+        if((heads[add] = next_compact(&readers[add])) == NULL){
+            heap_pop(&heap);
+        }else{
+            heap_sift_top(&heap);
+        }
+    }
+    for(int i = 0; i < n; i++){
+        free_compact_reader(&readers[i]);
+    }
+    wait_children(n);
+    finish_compact_writer(&writer);
+    if (close(out_fd) == -1) {
+        perror("close");
         exit(1);
     }
-    return compare_list;
+    close(fd);
+    free(index);
 }
 
 
 int main(int argc, char *argv[]) {   
-    char *infile;
-    char *outfile;
+    char *infile = NULL;
+    char *outfile = NULL;
     //the number of the process
-    int n;
+    int n = 0;
+    //how the children hand their sorted records to the parent
+    char *engine = "pipe";
+    //bytes of memory to sort with, or 0 to sort each slice in memory
+    size_t budget = 0;
+    //write only the first k records of the output, or all if 0
+    long k = 0;
+    //with k, take the records with the highest freq instead of the lowest
+    int reverse = 0;
+    //the order to sort in, as a set of KEY_ bits
+    int key;
+    //a sorted file to merge the sorted input into, and its sparse index
+    char *basefile = NULL;
+    char *indexfile = NULL;
     //for output file
     FILE *f2;
-    //if the incorrect number of command-line arguments 
-    //or incorrect options are provided,report that using the 
-    //message and exit the program with an exit code of 1
-    if(argc != 7){
-        fprintf(stderr, "Usage: psort -n <number of processes> -f <inputfile> -o <outputfile>\n");
-        exit(1);
-    }
-    //getopt part for detect incorrect input
+    //getopt part for detect incorrect input;
+    //if incorrect options are provided or a required one is missing,
+    //report that using the message and exit the program with an exit code of 1
     int opt;
-    while((opt = getopt(argc, argv, "n:f:o:")) != -1){
+    while((opt = getopt(argc, argv, "n:f:o:e:m:k:rs:ta:x:")) != -1){
         switch(opt)
         {
              case 'n':
+                //-n auto is worked out once the input size is known
+                if(strcmp(optarg, "auto") == 0){
+                    n = -1;
+                    break;
+                }
                 n = (int)strtol(optarg, NULL, 10);
                 if(n <= 0){
                    n=1;
@@ -97,27 +267,127 @@ int main(int argc, char *argv[]) {
              case 'o':
                 outfile = optarg;
                 
+                break;
+             case 'e':
+                engine = optarg;
+                
+                break;
+             case 'm':
+                if((budget = parse_size(optarg)) == 0){
+                    fprintf(stderr, USAGE);
+                    exit(1);
+                }
+                
+                break;
+             case 'k':
+                k = strtol(optarg, NULL, 10);
+                if(k <= 0){
+                    fprintf(stderr, USAGE);
+                    exit(1);
+                }
+
+                break;
+             case 'r':
+                reverse = 1;
+
+                break;
+             case 's':
+                if((key = parse_sort_key(optarg)) == -1){
+                    fprintf(stderr, USAGE);
+                    exit(1);
+                }
+                set_sort_key(key);
+
+                break;
+             case 't':
+                timing = 1;
+
+                break;
+             case 'a':
+                basefile = optarg;
+
+                break;
+             case 'x':
+                indexfile = optarg;
+
                 break;
              default:
-                fprintf(stderr, "Usage: psort -n <number of processes> -f <inputfile> -o <outputfile>\n");
+                fprintf(stderr, USAGE);
                 exit(1);
          }
     }
-    /*if(optind < argc){
-        fprintf(stderr, "Usage: psort -n <number of processes> -f <inputfile> -o <outputfile>\n");
+    if(n == 0 || infile == NULL || outfile == NULL || optind < argc ||
+       (strcmp(engine, "pipe") != 0 && strcmp(engine, "shm") != 0 &&
+        strcmp(engine, "thread") != 0 && strcmp(engine, "sample") != 0) ||
+       (budget > 0 && strcmp(engine, "pipe") != 0) ||
+       (k > 0 && (budget > 0 || strcmp(engine, "pipe") != 0)) ||
+       (reverse && k == 0) ||
+       (basefile != NULL && (budget > 0 || k > 0 || timing || strcmp(engine, "pipe") != 0)) ||
+       (indexfile != NULL && basefile == NULL)){
+        fprintf(stderr, USAGE);
         exit(1);
-    }*/
+    }
 
-    //struct rec r;
-    //while(fread(&r, sizeof(struct rec), 1, f1) != 0){
-    //    printf("%d %s\n", r.freq, r.word);
-    //}
+    //input that is not a regular file, such as stdin ("-") or a pipe, has
+    //no size to split by
+    struct stat in_stat;
+    int streamed = strcmp(infile, "-") == 0 ||
+                   (stat(infile, &in_stat) == 0 && !S_ISREG(in_stat.st_mode));
+    if(basefile != NULL){
+        if(streamed || is_compact(infile)){
+            fprintf(stderr, "Error: the input merged with -a must be a regular file of records\n");
+            exit(1);
+        }
+        //the index holds freq only, which cannot find ranges of words
+        if(indexfile != NULL && (sort_key & KEY_WORD)){
+            fprintf(stderr, "Error: -x indexes freq only and cannot be used with -s freq,word\n");
+            exit(1);
+        }
+    }
+
+    if(n == -1){
+        //input that is streamed has no size to go by
+        if(streamed){
+            n = auto_procs(-1);
+        }else if(is_compact(infile)){
+            n = auto_procs(compact_records(infile));
+        }else{
+            n = auto_procs(get_file_size(infile) / sizeof(struct rec));
+        }
+    }
+    if(basefile != NULL){
+        append_sort(basefile, infile, outfile, n, indexfile);
+        return 0;
+    }
+
+    //streamed input is sorted in chunks as it comes in
+    if(streamed){
+        if(k > 0 || strcmp(engine, "pipe") != 0){
+            fprintf(stderr, "Error: streamed input is sorted by the pipe engine only\n");
+            exit(1);
+        }
+        int in_fd = strcmp(infile, "-") == 0 ? STDIN_FILENO : open(infile, O_RDONLY);
+        if (in_fd == -1) {
+            perror("open");
+            exit(1);
+        }
+        stream_sort(in_fd, outfile, n, budget);
+        return 0;
+    }
+    if(is_compact(infile)){
+        if(budget > 0 || k > 0 || strcmp(engine, "pipe") != 0){
+            fprintf(stderr, "Error: compact input is sorted by the pipe engine only\n");
+            exit(1);
+        }
+        compact_sort(infile, outfile, n);
+        return 0;
+    }
 
     int status;
     int pipe_fd[n][2];   
 
     //total element in the input file
-    int sum;    
+    long sum;    
     sum = get_file_size(infile)/sizeof(struct rec);
     
     //check if number of process is bigger than the whole number of element
@@ -138,14 +408,34 @@ int main(int argc, char *argv[]) {
         } 
         exit(0);
     }
+    if(k > 0){
+        top_k(infile, outfile, n, sum, k, reverse);
+        return 0;
+    }
+    if(budget > 0){
+        external_sort(infile, outfile, n, sum, budget);
+        return 0;
+    }
+    if(strcmp(engine, "thread") == 0){
+        thread_sort(infile, outfile, n, sum);
+        return 0;
+    }
+    if(strcmp(engine, "sample") == 0){
+        sample_sort(infile, outfile, n, sum);
+        return 0;
+    }
+    if(strcmp(engine, "shm") == 0){
+        shm_sort(infile, outfile, n, sum);
+        return 0;
+    }
     // the number of element for each child
-    int whether;
+    long whether;
     
     int result = 1;
     int i = 1;
-    int remainder = sum % n;
+    long remainder = sum % n;
     //the element has been read
-    int current = 0;
+    long current = 0;
     //the number of the previous children
     int child_no;
 
@@ -162,6 +452,7 @@ int main(int argc, char *argv[]) {
                 perror("fork");
                 exit(1);
             }else if(result == 0){
+                 pin_child(i - 1);
                   
                  // before we forked the parent had open the reading ends to
                  // all previously forked children -- so close those
@@ -187,12 +478,16 @@ int main(int argc, char *argv[]) {
                   
                   //get the sorted list of the element by call sort function
                   struct rec* compare_list = sort(infile,current,whether);
-                  //write into pipe
-                  for(int k = 0;k < whether;k++){
-                     if (write(pipe_fd[i-1][1], &compare_list[k], sizeof(struct rec)) == -1){
-                          perror("write from child to pipe");
-                          exit(1);
-                     } 
+                  //write into pipe all at once; write_full carries on
+                  //after the partial writes a full pipe gives
+                  double send_started = now_msec();
+                  if (write_full(pipe_fd[i-1][1], compare_list, whether * sizeof(struct rec)) == -1){
+                      perror("write from child to pipe");
+                      exit(1);
+                  }
+                  if(timing){
+                      fprintf(stderr, "timing: child %d records %ld read %.3f sort %.3f send %.3f\n",
+                              getpid(), whether, read_ms, sort_ms, now_msec() - send_started);
                   }
                   free(compare_list);                    
                   // I'm done with the pipe so close it
@@ -221,28 +516,68 @@ int main(int argc, char *argv[]) {
     }
     
     //open the output file
-    f2 = fopen(outfile, "wb");
-    if (f2 == NULL) {
-        perror("fopen\n");
+    int out_fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd == -1) {
+        perror("open");
         exit(1);
     }
+    //merged records are gathered in out and written a block at a time
+    long block = WRITE_BLOCK / sizeof(struct rec);
+    long used = 0;
+    struct rec *out = malloc(block * sizeof(struct rec));
+    if (out == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    double merge_started = now_msec(), write_ms = 0;
     //the number of the index of the list which need to add
     int add; 
     //the list containing all the smallest elements of the child
-    struct rec min_list[n];
+    struct rec *min_list[n];
+    //the heap of children ordered by their smallest element;
+    //a child leaves the heap once its pipe is empty
+    int heap_runs[n];
+    struct merge_heap heap;
+    init_merge_heap(&heap, min_list, heap_runs, sort_key);
+    //each pipe is read PIPE_BLOCK bytes at a time
+    struct rec_reader readers[n];
     //start merge!
     for(int i = 0;i < n;i++){
-        if(read(pipe_fd[i][0], &(min_list[i]), sizeof(struct rec)) == 0){
+        init_rec_reader(&readers[i], pipe_fd[i][0], PIPE_BLOCK / sizeof(struct rec));
+        if((min_list[i] = next_rec(&readers[i])) == NULL){
             fprintf(stderr,"fail to read");
             exit(1);
         }
+        heap_push(&heap, i);
     }
-    for(int i = 0;i < sum;i++){
-        add=merge(min_list, f2,n);
-        if(read(pipe_fd[add][0], &(min_list[add]), sizeof(struct rec)) == 0){
-            min_list[add].freq = -2;
+    while(heap.size > 0){
+        add=merge(&heap, &out[used++]);
+        if(used == block){
+            double write_started = now_msec();
+            if (write_full(out_fd, out, used * sizeof(struct rec)) == -1){
+                perror("write");
+                exit(1);
+            }
+            write_ms += now_msec() - write_started;
+            used = 0;
+        }
+        if((min_list[add] = next_rec(&readers[add])) == NULL){
+            heap_pop(&heap);
+        }else{
+            heap_sift_top(&heap);
         }
     } 
+    double write_started = now_msec();
+    if (write_full(out_fd, out, used * sizeof(struct rec)) == -1){
+        perror("write");
+        exit(1);
+    }
+    write_ms += now_msec() - write_started;
+    double merge_ms = now_msec() - merge_started - write_ms;
+    free(out);
+    for(int i = 0;i < n;i++){
+        free_rec_reader(&readers[i]);
+    }
     
     //wait for children ending successfully
     for (int t = 0; t < n; t++) {
@@ -256,10 +591,16 @@ int main(int argc, char *argv[]) {
     }
     
     //close output file
-    if(fclose(f2) != 0){
-        perror("fclose\n");
+    write_started = now_msec();
+    if(close(out_fd) == -1){
+        perror("close");
         exit(1);
     }
+    write_ms += now_msec() - write_started;
+    if(timing){
+        fprintf(stderr, "timing: parent records %ld merge %.3f write %.3f\n",
+                sum, merge_ms, write_ms);
+    }
 
     return 0;
 }
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "helper.h"
+#include "compact.h"
+
+#define USAGE "Usage: reccvt -c|-x -f <input file name> -o <output file name>\n"
+
+/* This program converts a file of records between the fixed 48-byte layout
+ * made by mkwords and the compact layout (see compact.h). -c makes a fixed
+ * file compact, and -x makes a compact file fixed again. psort sorts
+ * files in either layout and writes the output in the same one.
+ */
+
+// write the fixed records of in_fd to out_fd in the compact layout
+static void to_compact(char *infile, int in_fd, int out_fd) {
+    long count = get_file_size(infile) / sizeof(struct rec);
+    struct rec_reader reader;
+    struct compact_writer writer;
+
+    init_rec_reader(&reader, in_fd, READ_BLOCK / sizeof(struct rec));
+    init_compact_writer(&writer, out_fd, READ_BLOCK, count);
+    for (long i = 0; i < count; i++) {
+        struct rec *r = next_rec(&reader);
+        if (r == NULL) {
+            fprintf(stderr, "Error: could not read %s\n", infile);
+            exit(1);
+        }
+        compact_write(&writer, r);
+    }
+    finish_compact_writer(&writer);
+    free_rec_reader(&reader);
+}
+
+// write the compact records of in_fd to out_fd in the fixed layout
+static void to_fixed(int in_fd, int out_fd) {
+    struct compact_header header;
+    struct compact_reader reader;
+    uint64_t *index = read_compact_header(in_fd, &header);
+    long block = READ_BLOCK / sizeof(struct rec);
+    struct rec *out = malloc(block * sizeof(struct rec));
+    struct rec *r;
+    long used = 0;
+
+    if (out == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    if (lseek(in_fd, sizeof(header) + header.index_size * sizeof(uint64_t),
+              SEEK_SET) == -1) {
+        perror("lseek");
+        exit(1);
+    }
+    init_compact_reader(&reader, in_fd, READ_BLOCK, header.count);
+    while ((r = next_compact(&reader)) != NULL) {
+        out[used++] = *r;
+        if (used == block) {
+            if (write_full(out_fd, out, used * sizeof(struct rec)) == -1) {
+                perror("write");
+                exit(1);
+            }
+            used = 0;
+        }
+    }
+    if (write_full(out_fd, out, used * sizeof(struct rec)) == -1) {
+        perror("write");
+        exit(1);
+    }
+    free_compact_reader(&reader);
+    free(out);
+    free(index);
+}
+
+int main(int argc, char *argv[]) {
+    char *infile = NULL, *outfile = NULL;
+    int compact = -1;
+    int ch, in_fd, out_fd;
+
+    while ((ch = getopt(argc, argv, "cxf:o:")) != -1) {
+        switch (ch) {
+        case 'c':
+            compact = 1;
+            break;
+        case 'x':
+            compact = 0;
+            break;
+        case 'f':
+            infile = optarg;
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        default:
+            fprintf(stderr, USAGE);
+            exit(1);
+        }
+    }
+    if (compact == -1 || infile == NULL || outfile == NULL || optind < argc) {
+        fprintf(stderr, USAGE);
+        exit(1);
+    }
+
+    if ((in_fd = open(infile, O_RDONLY)) == -1) {
+        perror(infile);
+        exit(1);
+    }
+    if ((out_fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+        perror(outfile);
+        exit(1);
+    }
+    if (compact) {
+        to_compact(infile, in_fd, out_fd);
+    } else {
+        to_fixed(in_fd, out_fd);
+    }
+    if (close(in_fd) == -1 || close(out_fd) == -1) {
+        perror("close");
+        exit(1);
+    }
+    return 0;
+}
@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "recsort.h"
+
+/* The sort key of one record: its freq, with the sign bit flipped so that
+ * keys compare as unsigned, and its index in the records being sorted.
+ */
+struct sort_key {
+    uint32_t key;
+    uint32_t index;
+};
+
+/* Sort recs by freq with a counting sort, given that every freq is in
+ * [min, min + range), from highest to lowest if desc is 1. Records with
+ * equal freq keep their order.
+ * Return 0, leaving recs alone, if there is not enough memory.
+ */
+static int counting_sort(struct rec *recs, long count, int min, long range, int desc) {
+    long *starts = calloc(range + 1, sizeof(long));
+    struct rec *sorted = malloc(count * sizeof(struct rec));
+
+    if (starts == NULL || sorted == NULL) {
+        free(starts);
+        free(sorted);
+        return 0;
+    }
+    // starts[k] becomes the index of the first record with freq min + k,
+    // or max - k if desc
+    int base = desc ? min + range - 1 : min;
+    int sign = desc ? -1 : 1;
+    for (long i = 0; i < count; i++) {
+        starts[sign * (recs[i].freq - base) + 1]++;
+    }
+    for (long k = 1; k <= range; k++) {
+        starts[k] += starts[k - 1];
+    }
+    for (long i = 0; i < count; i++) {
+        sorted[starts[sign * (recs[i].freq - base)]++] = recs[i];
+    }
+    memcpy(recs, sorted, count * sizeof(struct rec));
+    free(starts);
+    free(sorted);
+    return 1;
+}
+
+/* Sort recs by freq by sorting 8-byte (freq, index) keys instead of the
+ * 48-byte records, with a least significant byte first radix sort, which
+ * keeps records with equal freq in order. The records are then moved
+ * once, into their sorted places. If desc is 1 the keys are inverted, so
+ * the highest freq comes first.
+ * Return 0, leaving recs alone, if there is not enough memory.
+ */
+static int key_sort(struct rec *recs, long count, int desc) {
+    struct sort_key *keys = malloc(count * sizeof(struct sort_key));
+    struct sort_key *tmp = malloc(count * sizeof(struct sort_key));
+
+    if (keys == NULL || tmp == NULL || count > UINT32_MAX) {
+        free(keys);
+        free(tmp);
+        return 0;
+    }
+    for (long i = 0; i < count; i++) {
+        keys[i].key = (uint32_t) recs[i].freq ^ (desc ? 0x7fffffffu : 0x80000000u);
+        keys[i].index = i;
+    }
+    for (int shift = 0; shift < 32; shift += RADIX_BITS) {
+        long starts[(1 << RADIX_BITS) + 1];
+        memset(starts, 0, sizeof(starts));
+        for (long i = 0; i < count; i++) {
+            starts[((keys[i].key >> shift) & ((1 << RADIX_BITS) - 1)) + 1]++;
+        }
+        // a pass where every key has the same digit would change nothing
+        if (starts[((keys[0].key >> shift) & ((1 << RADIX_BITS) - 1)) + 1] == count) {
+            continue;
+        }
+        for (int d = 1; d <= 1 << RADIX_BITS; d++) {
+            starts[d] += starts[d - 1];
+        }
+        for (long i = 0; i < count; i++) {
+            tmp[starts[(keys[i].key >> shift) & ((1 << RADIX_BITS) - 1)]++] = keys[i];
+        }
+        struct sort_key *swap = keys;
+        keys = tmp;
+        tmp = swap;
+    }
+    free(tmp);
+
+    // record keys[i].index goes to i; follow each cycle of moves with
+    // one record held aside, marking done places by pointing them to
+    // themselves
+    for (long i = 0; i < count; i++) {
+        if (keys[i].index == i) {
+            continue;
+        }
+        struct rec held = recs[i];
+        long j = i;
+        while (keys[j].index != i) {
+            long from = keys[j].index;
+            recs[j] = recs[from];
+            keys[j].index = j;
+            j = from;
+        }
+        recs[j] = held;
+        keys[j].index = j;
+    }
+    free(keys);
+    return 1;
+}
+
+/* Sort count records by sort key key with a merge sort, which keeps
+ * records that are equal under it in order. tmp has room for count records.
+ */
+PER_KEY void merge_sort_key(struct rec *recs, long count, struct rec *tmp, const int key) {
+    struct rec *from = recs, *to = tmp;
+
+    // insertion sort runs of WORD_RUN records, then merge runs pairwise
+    for (long lo = 0; lo < count; lo += WORD_RUN) {
+        long hi = lo + WORD_RUN < count ? lo + WORD_RUN : count;
+        for (long i = lo + 1; i < hi; i++) {
+            struct rec moving = recs[i];
+            long j = i;
+            while (j > lo && rec_compare(key, &recs[j - 1], &moving) > 0) {
+                recs[j] = recs[j - 1];
+                j--;
+            }
+            recs[j] = moving;
+        }
+    }
+    for (long width = WORD_RUN; width < count; width *= 2) {
+        for (long lo = 0; lo < count; lo += 2 * width) {
+            long mid = lo + width < count ? lo + width : count;
+            long hi = lo + 2 * width < count ? lo + 2 * width : count;
+            long i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                to[k++] = rec_compare(key, &from[i], &from[j]) > 0 ? from[j++] : from[i++];
+            }
+            while (i < mid) {
+                to[k++] = from[i++];
+            }
+            while (j < hi) {
+                to[k++] = from[j++];
+            }
+        }
+        struct rec *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != recs) {
+        memcpy(recs, from, count * sizeof(struct rec));
+    }
+}
+
+static void merge_sort(struct rec *recs, long count, struct rec *tmp, int key) {
+    KEY_SWITCH(key, merge_sort_key(recs, count, tmp, K));
+}
+
+// swap the first n1 records of recs with the n2 after them
+static void rotate_recs(struct rec *recs, long n1, long n2) {
+    long ranges[3][2] = {{0, n1}, {n1, n1 + n2}, {0, n1 + n2}};
+
+    for (int r = 0; r < 3; r++) {
+        for (long i = ranges[r][0], j = ranges[r][1] - 1; i < j; i++, j--) {
+            struct rec swap = recs[i];
+            recs[i] = recs[j];
+            recs[j] = swap;
+        }
+    }
+}
+
+/* Return the index of the first of count sorted records that sorts after
+ * r, or if after is 0, that does not sort before r.
+ */
+PER_KEY long bound_key(const struct rec *recs, long count, const struct rec *r,
+                       int after, const int key) {
+    long lo = 0, hi = count;
+
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        int c = rec_compare(key, &recs[mid], r);
+        if (c < 0 || (after && c == 0)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void merge_in_place(struct rec *recs, long n1, long n2,
+                           struct rec *buf, long buf_size, int key);
+
+/* Merge the sorted records recs[0, n1) and recs[n1, n1 + n2) in place,
+ * keeping equal records in order, with buf, which has room for buf_size
+ * records. Once either side fits in buf it is merged through buf as usual;
+ * until then the bigger side is split in half, the other side at the
+ * matching record, and the two middle pieces are swapped by a rotation,
+ * leaving two smaller merges.
+ */
+PER_KEY void merge_in_place_key(struct rec *recs, long n1, long n2,
+                                struct rec *buf, long buf_size, const int key) {
+    while (n1 > 0 && n2 > 0 && rec_compare(key, &recs[n1 - 1], &recs[n1]) > 0) {
+        if (n1 <= buf_size) {
+            struct rec *right = recs + n1, *end = recs + n1 + n2;
+            long i = 0, k = 0;
+            memcpy(buf, recs, n1 * sizeof(struct rec));
+            while (i < n1 && right < end) {
+                recs[k++] = rec_compare(key, &buf[i], right) > 0 ? *right++ : buf[i++];
+            }
+            memcpy(recs + k, buf + i, (n1 - i) * sizeof(struct rec));
+            return;
+        }
+        if (n2 <= buf_size) {
+            long i = n1 - 1, j = n2 - 1, k = n1 + n2 - 1;
+            memcpy(buf, recs + n1, n2 * sizeof(struct rec));
+            while (i >= 0 && j >= 0) {
+                recs[k--] = rec_compare(key, &recs[i], &buf[j]) > 0 ? recs[i--] : buf[j--];
+            }
+            memcpy(recs, buf, (j + 1) * sizeof(struct rec));
+            return;
+        }
+        long cut1, cut2;
+        if (n1 >= n2) {
+            cut1 = n1 / 2;
+            cut2 = bound_key(recs + n1, n2, &recs[cut1], 0, key);
+        } else {
+            cut2 = n2 / 2;
+            cut1 = bound_key(recs, n1, &recs[n1 + cut2], 1, key);
+        }
+        rotate_recs(recs + cut1, n1 - cut1, cut2);
+        // recurse into the smaller merge and loop on the bigger one, so
+        // that the recursion is at most log2(n1 + n2) deep
+        if (cut1 + cut2 < n1 + n2 - cut1 - cut2) {
+            merge_in_place(recs, cut1, cut2, buf, buf_size, key);
+            recs += cut1 + cut2;
+            n1 -= cut1;
+            n2 -= cut2;
+        } else {
+            merge_in_place(recs + cut1 + cut2, n1 - cut1, n2 - cut2, buf, buf_size, key);
+            n1 = cut1;
+            n2 = cut2;
+        }
+    }
+}
+
+static void merge_in_place(struct rec *recs, long n1, long n2,
+                           struct rec *buf, long buf_size, int key) {
+    KEY_SWITCH(key, merge_in_place_key(recs, n1, n2, buf, buf_size, K));
+}
+
+/* Sort count records by sort key key with a merge sort that needs only
+ * buf, which has room for buf_size records, and keeps records that are
+ * equal under the key in order. Blocks of buf_size records are merge
+ * sorted through buf, and the blocks are then merged in place.
+ */
+static void merge_sort_small(struct rec *recs, long count,
+                             struct rec *buf, long buf_size, int key) {
+    for (long lo = 0; lo < count; lo += buf_size) {
+        merge_sort(recs + lo, count - lo < buf_size ? count - lo : buf_size, buf, key);
+    }
+    for (long width = buf_size; width < count; width *= 2) {
+        for (long lo = 0; lo + width < count; lo += 2 * width) {
+            long n2 = count - lo - width < width ? count - lo - width : width;
+            merge_in_place(recs + lo, width, n2, buf, buf_size, key);
+        }
+    }
+}
+
+/* Given count records sorted by freq, sort each run of records with equal
+ * freq by word.
+ */
+static void sort_ties(struct rec *recs, long count) {
+    struct rec *tmp = NULL;
+    long tmp_size = 0;
+
+    for (long i = 0; i < count; ) {
+        long j = i + 1;
+        while (j < count && recs[j].freq == recs[i].freq) {
+            j++;
+        }
+        if (j - i > 1) {
+            if (j - i > tmp_size) {
+                tmp_size = j - i;
+                if ((tmp = realloc(tmp, tmp_size * sizeof(struct rec))) == NULL) {
+                    perror("realloc");
+                    exit(1);
+                }
+            }
+            merge_sort(recs + i, j - i, tmp, KEY_WORD);
+        }
+        i = j;
+    }
+    free(tmp);
+}
+
+/* Sort count records by sort_key. Records that are equal under it keep
+ * their order. The records are sorted by freq with a counting sort when
+ * the freq values span at most COUNT_SORT_RANGE, or by their keys
+ * otherwise, and then ties are sorted by word if the key asks for it.
+ * Small counts are merge sorted on the stack. If the other sorts cannot
+ * get their memory, a merge sort that merges in place with MERGE_BUFFER
+ * records of scratch, or COUNT_SORT_MIN on the stack if even that is not
+ * available, is used instead; qsort is not used, as it need not keep
+ * equal records in order.
+ */
+void sort_recs(struct rec *recs, long count) {
+    int desc = (sort_key & KEY_DESC) != 0;
+
+    if (count < COUNT_SORT_MIN) {
+        struct rec tmp[COUNT_SORT_MIN];
+        merge_sort(recs, count, tmp, sort_key);
+        return;
+    }
+    int min = recs[0].freq, max = recs[0].freq;
+    for (long i = 1; i < count; i++) {
+        if (recs[i].freq < min) {
+            min = recs[i].freq;
+        } else if (recs[i].freq > max) {
+            max = recs[i].freq;
+        }
+    }
+    if (((long) max - min < COUNT_SORT_RANGE &&
+         counting_sort(recs, count, min, (long) max - min + 1, desc)) ||
+        key_sort(recs, count, desc)) {
+        if (sort_key & KEY_WORD) {
+            sort_ties(recs, count);
+        }
+        return;
+    }
+    struct rec small[COUNT_SORT_MIN];
+    struct rec *buf = malloc(MERGE_BUFFER * sizeof(struct rec));
+    if (buf == NULL) {
+        merge_sort_small(recs, count, small, COUNT_SORT_MIN, sort_key);
+        return;
+    }
+    merge_sort_small(recs, count, buf, MERGE_BUFFER, sort_key);
+    free(buf);
+}
+
+/* Sort the sum records of infile with n children, each sorting one slice
+ * into a shared anonymous mapping, and return the mapping, which the
+ * caller must munmap. start must have room for n + 1 entries; slice i is
+ * records [start[i], start[i + 1]), split as the pipe engine splits them.
+ */
+struct rec *sort_shared(char *infile, int n, long sum, long *start) {
+    size_t size = (size_t) sum * sizeof(struct rec);
+    int fd = open(infile, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        exit(1);
+    }
+    struct rec *in = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (in == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    if (close(fd) == -1) {
+        perror("close");
+        exit(1);
+    }
+    struct rec *runs = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (runs == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+
+    for (int i = 0; i <= n; i++) {
+        start[i] = i * (sum / n) + (i < sum % n ? i : sum % n);
+    }
+    for (int i = 0; i < n; i++) {
+        int result = fork();
+        if (result < 0) {
+            perror("fork");
+            exit(1);
+        } else if (result == 0) {
+            pin_child(i);
+            long whether = start[i + 1] - start[i];
+            memcpy(runs + start[i], in + start[i], whether * sizeof(struct rec));
+            sort_recs(runs + start[i], whether);
+            exit(0);
+        }
+    }
+    wait_children(n);
+    if (munmap(in, size) == -1) {
+        perror("munmap");
+        exit(1);
+    }
+    return runs;
+}
@@ -0,0 +1,24 @@
+#ifndef _RECSORT_H
+#define _RECSORT_H
+
+#include "helper.h"
+
+/* Widest range of freq values sorted by counting sort instead of by key. */
+#define COUNT_SORT_RANGE (1 << 16)
+
+/* Fewest records worth setting up a counting sort for. */
+#define COUNT_SORT_MIN 64
+
+/* Bits of the key sorted on by each pass of the radix sort of keys. */
+#define RADIX_BITS 8
+
+/* Records sorted by insertion before merge_sort merges them. */
+#define WORD_RUN 16
+
+/* Records of scratch space the low-memory merge sort asks for. */
+#define MERGE_BUFFER 4096
+
+void sort_recs(struct rec *recs, long count);
+struct rec *sort_shared(char *infile, int n, long sum, long *start);
+
+#endif /* _RECSORT_H */
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "helper.h"
+#include "recsort.h"
+#include "samplesort.h"
+
+// map size bytes that forked children share with the parent
+static void *map_shared(size_t size) {
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    return p;
+}
+
+/* A sampled record with its index in the input. Splitters order records
+ * by key and then by index, so that records with equal keys can still be
+ * cut into different buckets.
+ */
+struct splitter {
+    long index;
+    struct rec rec;
+};
+
+static int compare_splitters(const void *a, const void *b) {
+    const struct splitter *x = a, *y = b;
+    int cmp = rec_compare(sort_key, &x->rec, &y->rec);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+/* Pick n - 1 splitters from evenly spaced records of in. Bucket j holds
+ * the records above splitter j - 1 and at most splitter j.
+ */
+static void pick_splitters(struct rec *in, long sum, int n, struct splitter *splitters) {
+    long m = (long) n * OVERSAMPLE;
+    if (m > sum) {
+        m = sum;
+    }
+    struct splitter *sample = malloc(m * sizeof(struct splitter));
+    if (sample == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (long i = 0; i < m; i++) {
+        sample[i].index = i * (sum / m);
+        sample[i].rec = in[sample[i].index];
+    }
+    // no two samples are equal, so qsort's order is the only one
+    qsort(sample, m, sizeof(struct splitter), compare_splitters);
+    for (int j = 0; j < n - 1; j++) {
+        splitters[j] = sample[(j + 1) * m / n];
+    }
+    free(sample);
+}
+
+// return the bucket of r, record index of the input: the number of
+// splitters that come before it
+PER_KEY int bucket_of(struct rec *r, long index, struct splitter *splitters, int n,
+                      const int key) {
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = rec_compare(key, &splitters[mid].rec, r);
+        if (cmp < 0 || (cmp == 0 && splitters[mid].index < index)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// count the records [lo, hi) of in that fall in each bucket
+PER_KEY void count_buckets(struct rec *in, long lo, long hi, struct splitter *splitters,
+                           int n, long *counts, const int key) {
+    for (long k = lo; k < hi; k++) {
+        counts[bucket_of(&in[k], k, splitters, n, key)]++;
+    }
+}
+
+// copy the records [lo, hi) of in to their buckets, next[j] being where
+// the next one of bucket j goes
+PER_KEY void fill_buckets(struct rec *in, long lo, long hi, struct splitter *splitters,
+                          int n, long *next, struct rec *buckets, const int key) {
+    for (long k = lo; k < hi; k++) {
+        buckets[next[bucket_of(&in[k], k, splitters, n, key)]++] = in[k];
+    }
+}
+
+/* Sort the sum records of infile into outfile with n children and no
+ * merge. The parent samples the input for n - 1 splitters, which cut the
+ * keys into n buckets. The children count how many records of their
+ * slice fall in each bucket, and from those counts the parent works out
+ * where each child's records of each bucket go. The children then copy
+ * their records there, and finally child j sorts bucket j and writes it
+ * straight to its place in outfile.
+ * Records keep their input order within a bucket until it is sorted, and
+ * records with equal keys are cut into buckets by their place in the
+ * input, so the output is the same as that of the other engines. That
+ * also keeps the buckets even when many records have the same key.
+ */
+void sample_sort(char *infile, char *outfile, int n, long sum) {
+    size_t size = (size_t) sum * sizeof(struct rec);
+    struct splitter splitters[n];
+    long start[n + 1];
+    // bucket_start[j] is the first record of bucket j in the output
+    long bucket_start[n + 1];
+
+    int fd = open(infile, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        exit(1);
+    }
+    struct rec *in = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (in == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    if (close(fd) == -1) {
+        perror("close");
+        exit(1);
+    }
+    pick_splitters(in, sum, n, splitters);
+    for (int i = 0; i <= n; i++) {
+        start[i] = i * (sum / n) + (i < sum % n ? i : sum % n);
+    }
+
+    // counts[i * n + j] is the number of records of slice i in bucket j
+    long *counts = map_shared((size_t) n * n * sizeof(long));
+    for (int i = 0; i < n; i++) {
+        int result = fork();
+        if (result < 0) {
+            perror("fork");
+            exit(1);
+        } else if (result == 0) {
+            pin_child(i);
+            KEY_SWITCH(sort_key, count_buckets(in, start[i], start[i + 1], splitters, n,
+                                               &counts[i * n], K));
+            exit(0);
+        }
+    }
+    wait_children(n);
+
+    // turn the counts into the place of each slice's part of each bucket
+    long pos = 0;
+    for (int j = 0; j < n; j++) {
+        bucket_start[j] = pos;
+        for (int i = 0; i < n; i++) {
+            long count = counts[i * n + j];
+            counts[i * n + j] = pos;
+            pos += count;
+        }
+    }
+    bucket_start[n] = pos;
+
+    struct rec *buckets = map_shared(size);
+    for (int i = 0; i < n; i++) {
+        int result = fork();
+        if (result < 0) {
+            perror("fork");
+            exit(1);
+        } else if (result == 0) {
+            pin_child(i);
+            KEY_SWITCH(sort_key, fill_buckets(in, start[i], start[i + 1], splitters, n,
+                                              &counts[i * n], buckets, K));
+            exit(0);
+        }
+    }
+    wait_children(n);
+    if (munmap(in, size) == -1 || munmap(counts, (size_t) n * n * sizeof(long)) == -1) {
+        perror("munmap");
+        exit(1);
+    }
+
+    fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("open");
+        exit(1);
+    }
+    for (int j = 0; j < n; j++) {
+        int result = fork();
+        if (result < 0) {
+            perror("fork");
+            exit(1);
+        } else if (result == 0) {
+            pin_child(j);
+            long count = bucket_start[j + 1] - bucket_start[j];
+            sort_recs(buckets + bucket_start[j], count);
+            if (pwrite_full(fd, buckets + bucket_start[j], count * sizeof(struct rec),
+                            (off_t) bucket_start[j] * sizeof(struct rec)) == -1) {
+                perror("pwrite");
+                exit(1);
+            }
+            exit(0);
+        }
+    }
+    wait_children(n);
+
+    if (munmap(buckets, size) == -1) {
+        perror("munmap");
+        exit(1);
+    }
+    if (close(fd) == -1) {
+        perror("close");
+        exit(1);
+    }
+}
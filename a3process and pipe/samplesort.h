@@ -0,0 +1,9 @@
+#ifndef _SAMPLESORT_H
+#define _SAMPLESORT_H
+
+/* Number of records sampled per child to choose the splitters. */
+#define OVERSAMPLE 64
+
+void sample_sort(char *infile, char *outfile, int n, long sum);
+
+#endif /* _SAMPLESORT_H */
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "helper.h"
+#include "merge.h"
+#include "topk.h"
+
+/* A record kept by a child, with its index in the input so that records
+ * with equal freq can be told apart.
+ */
+struct kept {
+    long index;
+    struct rec rec;
+};
+
+// the sort key of the output, which ties by place in the input
+static int order;
+
+// return non-zero if a comes after b in the output
+PER_KEY int after(struct kept *a, struct kept *b, const int key) {
+    int cmp = rec_compare(key, &a->rec, &b->rec);
+    return cmp > 0 || (cmp == 0 && a->index > b->index);
+}
+
+static int compare_kept(const void *a, const void *b) {
+    if (after((struct kept *) a, (struct kept *) b, order)) {
+        return 1;
+    }
+    return after((struct kept *) b, (struct kept *) a, order) ? -1 : 0;
+}
+
+// move kept[i] down the heap of size records, whose top comes last
+PER_KEY void sift_down(struct kept *heap, long size, long i, const int key) {
+    struct kept moving = heap[i];
+    while (2 * i + 1 < size) {
+        long child = 2 * i + 1;
+        if (child + 1 < size && after(&heap[child + 1], &heap[child], key)) {
+            child++;
+        }
+        if (!after(&heap[child], &moving, key)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = moving;
+}
+
+/* Keep in heap, which has room for k records, the first k in the output
+ * order of the count records from reader, the first of which is record
+ * start of the input. The k best records so far are kept in a heap whose
+ * top is the worst of them, so each further record is compared with the
+ * top only. Return the number of records kept.
+ */
+PER_KEY long select_recs(struct rec_reader *reader, struct kept *heap, long start,
+                         long count, long k, const int key) {
+    long size = 0;
+
+    for (long i = 0; i < count; i++) {
+        struct kept next;
+        struct rec *r = next_rec(reader);
+        if (r == NULL) {
+            fprintf(stderr, "Error: could not read input file\n");
+            exit(1);
+        }
+        next.index = start + i;
+        next.rec = *r;
+        if (size < k) {
+            // push: move next up from the bottom of the heap
+            long j = size++;
+            while (j > 0 && after(&next, &heap[(j - 1) / 2], key)) {
+                heap[j] = heap[(j - 1) / 2];
+                j = (j - 1) / 2;
+            }
+            heap[j] = next;
+        } else if (after(&heap[0], &next, key)) {
+            heap[0] = next;
+            sift_down(heap, size, 0, key);
+        }
+    }
+    return size;
+}
+
+/* The work of one child: find the first k records in the output order of
+ * records [start, start + count) of infile and write them, in that order,
+ * to fd.
+ */
+static void select_slice(char *infile, long start, long count, long k, int fd) {
+    struct kept *heap;
+    struct rec_reader reader;
+    long size = 0;
+    int in_fd;
+
+    if (k > count) {
+        k = count;
+    }
+    if ((heap = malloc(k * sizeof(struct kept))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    if ((in_fd = open(infile, O_RDONLY)) == -1) {
+        perror("open");
+        exit(1);
+    }
+    if (lseek(in_fd, (off_t) start * sizeof(struct rec), SEEK_SET) == -1) {
+        perror("lseek");
+        exit(1);
+    }
+    init_rec_reader(&reader, in_fd, PIPE_BLOCK / sizeof(struct rec));
+    KEY_SWITCH(order, size = select_recs(&reader, heap, start, count, k, K));
+    free_rec_reader(&reader);
+    close(in_fd);
+
+    qsort(heap, size, sizeof(struct kept), compare_kept);
+    // reuse the heap to hold the bare records for writing
+    struct rec *out = (struct rec *) heap;
+    for (long i = 0; i < size; i++) {
+        memmove(&out[i], &heap[i].rec, sizeof(struct rec));
+    }
+    if (write_full(fd, out, size * sizeof(struct rec)) == -1) {
+        perror("write to pipe");
+        exit(1);
+    }
+    free(heap);
+}
+
+/* Write the first k records of the sorted sum records of infile to
+ * outfile: those with the lowest freq, or the highest if reverse is 1,
+ * from lowest to highest or highest to lowest. Records with equal freq
+ * keep their input order.
+ * Each of n children keeps the best k records of its slice and sends just
+ * those down its pipe, so the parent merges at most n * k records.
+ */
+void top_k(char *infile, char *outfile, int n, long sum, long k, int reverse) {
+    int pipe_fd[n][2];
+    long start = 0;
+
+    order = reverse ? sort_key ^ KEY_DESC : sort_key;
+    for (int i = 0; i < n; i++) {
+        long whether = sum / n + (i < sum % n ? 1 : 0);
+        if (pipe(pipe_fd[i]) == -1) {
+            perror("pipe");
+            exit(1);
+        }
+        int result = fork();
+        if (result < 0) {
+            perror("fork");
+            exit(1);
+        } else if (result == 0) {
+            pin_child(i);
+            for (int j = 0; j <= i; j++) {
+                if (close(pipe_fd[j][0]) == -1) {
+                    perror("close reading end");
+                    exit(1);
+                }
+            }
+            select_slice(infile, start, whether, k, pipe_fd[i][1]);
+            if (close(pipe_fd[i][1]) == -1) {
+                perror("close pipe after writing");
+                exit(1);
+            }
+            exit(0);
+        }
+        if (close(pipe_fd[i][1]) == -1) {
+            perror("close writing end of pipe in parent");
+            exit(1);
+        }
+        start += whether;
+    }
+
+    FILE *f2 = fopen(outfile, "wb");
+    if (f2 == NULL) {
+        perror("fopen");
+        exit(1);
+    }
+    struct rec *heads[n];
+    int heap_runs[n];
+    struct merge_heap heap;
+    struct rec_reader readers[n];
+    init_merge_heap(&heap, heads, heap_runs, order);
+    for (int i = 0; i < n; i++) {
+        init_rec_reader(&readers[i], pipe_fd[i][0], PIPE_BLOCK / sizeof(struct rec));
+        if ((heads[i] = next_rec(&readers[i])) != NULL) {
+            heap_push(&heap, i);
+        }
+    }
+    for (long written = 0; written < k && heap.size > 0; written++) {
+        int top = heap_top(&heap);
+        if (fwrite(heads[top], sizeof(struct rec), 1, f2) != 1) {
+            fprintf(stderr, "Error: data not fully written to file\n");
+            exit(1);
+        }
+        if ((heads[top] = next_rec(&readers[top])) == NULL) {
+            heap_pop(&heap);
+        } else {
+            heap_sift_top(&heap);
+        }
+    }
+    // read what is left of the candidates so that no child is cut off
+    for (int i = 0; i < n; i++) {
+        while (next_rec(&readers[i]) != NULL) {
+        }
+        if (close(pipe_fd[i][0]) == -1) {
+            perror("close");
+            exit(1);
+        }
+        free_rec_reader(&readers[i]);
+    }
+    wait_children(n);
+    if (fclose(f2) != 0) {
+        perror("fclose");
+        exit(1);
+    }
+}
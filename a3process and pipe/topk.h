@@ -0,0 +1,6 @@
+#ifndef _TOPK_H
+#define _TOPK_H
+
+void top_k(char *infile, char *outfile, int n, long sum, long k, int reverse);
+
+#endif /* _TOPK_H */
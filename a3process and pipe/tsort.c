@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <pthread.h>
+#include "helper.h"
+#include "recsort.h"
+#include "tsort.h"
+
+/* A range of the buffer waiting to be sorted. A task lives on the stack
+ * of the worker that pushed it, which waits for done before returning.
+ */
+struct task {
+    long lo;
+    long hi;
+    int done;
+};
+
+/* A worker thread and its deque of tasks. The owner pushes and pops at
+ * the bottom; other workers steal from the top.
+ */
+struct worker {
+    pthread_t tid;
+    pthread_mutex_t lock;
+    struct task *deque[TASK_DEPTH];
+    int top;
+    int bottom;
+    unsigned int seed;
+};
+
+// shared by all workers while a sort runs
+static struct rec *buf;
+static struct rec *scratch;
+static struct worker *workers;
+static int num_workers;
+static int finished;
+
+static void push(struct worker *w, struct task *t) {
+    pthread_mutex_lock(&w->lock);
+    w->deque[w->bottom++] = t;
+    pthread_mutex_unlock(&w->lock);
+}
+
+// take back the newest task of w, or NULL if it was stolen
+static struct task *pop(struct worker *w) {
+    struct task *t = NULL;
+    pthread_mutex_lock(&w->lock);
+    if (w->bottom > w->top) {
+        t = w->deque[--w->bottom];
+    }
+    if (w->bottom == w->top) {
+        w->top = w->bottom = 0;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return t;
+}
+
+// take the oldest (biggest) task of a random other worker, or NULL
+static struct task *steal(struct worker *thief) {
+    struct worker *victim = &workers[rand_r(&thief->seed) % num_workers];
+    struct task *t = NULL;
+
+    if (victim == thief) {
+        return NULL;
+    }
+    pthread_mutex_lock(&victim->lock);
+    if (victim->bottom > victim->top) {
+        t = victim->deque[victim->top++];
+    }
+    pthread_mutex_unlock(&victim->lock);
+    return t;
+}
+
+// merge the sorted ranges [lo, mid) and [mid, hi); ties go to the left
+PER_KEY void merge_ranges_key(long lo, long mid, long hi, const int key) {
+    long i = lo, j = mid, k = lo;
+
+    while (i < mid && j < hi) {
+        if (rec_compare(key, &buf[j], &buf[i]) < 0) {
+            scratch[k++] = buf[j++];
+        } else {
+            scratch[k++] = buf[i++];
+        }
+    }
+    memcpy(&scratch[k], &buf[i], (mid - i) * sizeof(struct rec));
+    k += mid - i;
+    memcpy(&scratch[k], &buf[j], (hi - j) * sizeof(struct rec));
+    memcpy(&buf[lo], &scratch[lo], (hi - lo) * sizeof(struct rec));
+}
+
+static void merge_ranges(long lo, long mid, long hi) {
+    KEY_SWITCH(sort_key, merge_ranges_key(lo, mid, hi, K));
+}
+
+static void run_task(struct worker *w, struct task *t);
+
+/* Sort [lo, hi) of buf. The left half is offered to other workers while
+ * this worker sorts the right half; if it was stolen, this worker runs
+ * other workers' tasks until it is done.
+ */
+static void sort_range(struct worker *w, long lo, long hi) {
+    if (hi - lo <= LEAF_RECS) {
+        sort_recs(&buf[lo], hi - lo);
+        return;
+    }
+    long mid = lo + (hi - lo) / 2;
+    struct task left = {lo, mid, 0};
+
+    push(w, &left);
+    sort_range(w, mid, hi);
+    if (pop(w) == &left) {
+        sort_range(w, lo, mid);
+    } else {
+        while (!__atomic_load_n(&left.done, __ATOMIC_ACQUIRE)) {
+            struct task *t = steal(w);
+            if (t) {
+                run_task(w, t);
+            } else {
+                sched_yield();
+            }
+        }
+    }
+    merge_ranges(lo, mid, hi);
+}
+
+static void run_task(struct worker *w, struct task *t) {
+    sort_range(w, t->lo, t->hi);
+    __atomic_store_n(&t->done, 1, __ATOMIC_RELEASE);
+}
+
+// body of every worker but the first: steal work until the sort is over
+static void *work(void *arg) {
+    struct worker *w = arg;
+
+    // threads start with the affinity of their creator, so with -n auto
+    // they would all share the parent's CPU until they pin themselves
+    pin_child(w - workers);
+    while (!__atomic_load_n(&finished, __ATOMIC_ACQUIRE)) {
+        struct task *t = steal(w);
+        if (t) {
+            run_task(w, t);
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/* Sort the sum records of infile into outfile with n threads. The records
+ * are read into one buffer and sorted by a parallel merge sort whose
+ * halves are balanced between the threads by work stealing. Leaves are
+ * sorted with sort_recs and merges keep equal records in input order, so
+ * the output is the same as that of the process engines.
+ */
+void thread_sort(char *infile, char *outfile, int n, long sum) {
+    size_t size = (size_t) sum * sizeof(struct rec);
+    int fd;
+
+    if ((buf = malloc(size)) == NULL || (scratch = malloc(size)) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    if ((fd = open(infile, O_RDONLY)) == -1) {
+        perror("open");
+        exit(1);
+    }
+    read_recs(fd, buf, 0, sum);
+    close(fd);
+
+    num_workers = n;
+    finished = 0;
+    if ((workers = calloc(n, sizeof(struct worker))) == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        workers[i].seed = i + 1;
+        pthread_mutex_init(&workers[i].lock, NULL);
+    }
+    for (int i = 1; i < n; i++) {
+        if (pthread_create(&workers[i].tid, NULL, work, &workers[i]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    pin_child(0);
+    sort_range(&workers[0], 0, sum);
+    __atomic_store_n(&finished, 1, __ATOMIC_RELEASE);
+    for (int i = 1; i < n; i++) {
+        pthread_join(workers[i].tid, NULL);
+    }
+    for (int i = 0; i < n; i++) {
+        pthread_mutex_destroy(&workers[i].lock);
+    }
+    free(workers);
+
+    if ((fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+        perror("open");
+        exit(1);
+    }
+    if (write_full(fd, buf, size) == -1) {
+        perror("write");
+        exit(1);
+    }
+    if (close(fd) == -1) {
+        perror("close");
+        exit(1);
+    }
+    free(buf);
+    free(scratch);
+}
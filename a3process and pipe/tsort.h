@@ -0,0 +1,12 @@
+#ifndef _TSORT_H
+#define _TSORT_H
+
+/* Ranges of at most this many records are sorted by one thread. */
+#define LEAF_RECS 8192
+
+/* Room in each worker's deque; the merge sort recursion is never deeper. */
+#define TASK_DEPTH 64
+
+void thread_sort(char *infile, char *outfile, int n, long sum);
+
+#endif /* _TSORT_H */
@@ -12,9 +12,13 @@ struct client {
     int fd;
     struct in_addr ipaddr;
     struct client *next;
+    int in_game;          // 1 once the client has a name and is in the game
     char name[MAX_NAME];
     char inbuf[MAX_BUF];  // Used to hold input from the client
     char *in_ptr;         // A pointer into inbuf to help with partial reads
+    char *outbuf;         // Output the socket has not taken yet, or NULL
+    int out_len;          // Number of bytes in outbuf
+    int out_cap;          // Number of bytes outbuf has room for
 };
 
 // Information about the dictionary used to pick random word
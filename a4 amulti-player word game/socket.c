@@ -1,7 +1,10 @@
+#define _GNU_SOURCE        /* accept4 */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <arpa/inet.h>     /* inet_ntoa */
 #include <netdb.h>         /* gethostname */
 #include <sys/socket.h>
@@ -92,3 +95,40 @@ int accept_connection(int listenfd) {
 }
 
 
+/*
+ * Put the socket descriptor fd in non-blocking mode.
+ */
+void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("fcntl");
+        exit(1);
+    }
+}
+
+
+/*
+ * Accept a connection waiting on the non-blocking socket listenfd and
+ * store the client's address in peer.
+ * Return the client's socket descriptor, which is non-blocking too, or -1
+ * with errno set if no connection is waiting (EAGAIN) or no more
+ * descriptors can be opened (EMFILE or ENFILE).
+ */
+int accept_nonblocking(int listenfd, struct sockaddr_in *peer) {
+    socklen_t peer_len = sizeof(*peer);
+    int client_socket;
+
+    while ((client_socket = accept4(listenfd, (struct sockaddr *)peer, &peer_len,
+                                    SOCK_NONBLOCK)) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EMFILE ||
+            errno == ENFILE) {
+            return -1;
+        }
+        if (errno != EINTR && errno != ECONNABORTED) {
+            perror("accept");
+            exit(1);
+        }
+        peer_len = sizeof(*peer);
+    }
+    return client_socket;
+}
@@ -6,5 +6,7 @@
 struct sockaddr_in *init_server_addr(int port);
 int set_up_server_socket(struct sockaddr_in *self, int num_queue);
 int accept_connection(int listenfd);
+void set_nonblocking(int fd);
+int accept_nonblocking(int listenfd, struct sockaddr_in *peer);
 
 #endif
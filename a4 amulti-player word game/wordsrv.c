@@ -6,10 +6,15 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <time.h>
+#ifndef USE_SELECT
+#include <sys/epoll.h>
+#endif
 
 #include "socket.h"
 #include "gameplay.h"
@@ -22,11 +27,18 @@
 #define MAX_QUEUE 5
 #define _XOPEN_SOURCE
 
+/* Most events taken from epoll_wait at once. */
+#define MAX_EVENTS 256
+
+/* Most bytes of output queued for a client that is not reading before
+ * the client is dropped. */
+#define MAX_PENDING (64 * 1024)
+
 void add_player(struct client **top, int fd, struct in_addr addr);
 
 void remove_player(struct client **top, int fd);
 
-/* These are some of the function prototypes that we used in our solution 
+/* These are some of the function prototypes that we used in our solution
  * You are not required to write functions that match these prototypes, but
  * you may find the helpful when thinking about operations in your program.
  */
@@ -62,11 +74,29 @@ void broadcast_first_join(struct game_state *game, int *disconnect, int *disconn
 void guess_length_right(struct game_state *game, int *disconnect, int *disconnect_len, int max_fd, int *next_turn,
                         char *buf, int pfd);
 
+int client_write(int fd, const char *buf, size_t len);
+
+int read_input(struct client *p, int size);
+
+int read_player(struct game_state *game, struct client *p, int *disconnect, int *disconnect_len, int max_fd,
+                char *argvv);
+
+int read_new_player(struct game_state *game, struct client **new_players, struct client *p, int *disconnect,
+                    int *disconnect_len, int max_fd);
+
+#ifdef USE_SELECT
 /* The set of socket descriptors for select to monitor.
  * This is a global variable because we need to remove socket descriptors
  * from allset when a write to a socket fails.
  */
 fd_set allset;
+#else
+/* The client on each socket descriptor, so that output for a descriptor
+ * can be queued on its client, and how many descriptors it has room for.
+ */
+struct client **clients = NULL;
+int clients_cap = 0;
+#endif
 
 
 /* Add a client to the head of the linked list
@@ -83,15 +113,35 @@ void add_player(struct client **top, int fd, struct in_addr addr) {
 
     p->fd = fd;
     p->ipaddr = addr;
+    p->in_game = 0;
     p->name[0] = '\0';
     p->in_ptr = p->inbuf;
     p->inbuf[0] = '\0';
+    p->outbuf = NULL;
+    p->out_len = 0;
+    p->out_cap = 0;
     p->next = *top;
     *top = p;
+#ifndef USE_SELECT
+    if (fd >= clients_cap) {
+        int cap = clients_cap ? clients_cap : 64;
+        while (cap <= fd) {
+            cap *= 2;
+        }
+        if ((clients = realloc(clients, cap * sizeof(struct client *))) == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+        memset(clients + clients_cap, 0, (cap - clients_cap) * sizeof(struct client *));
+        clients_cap = cap;
+    }
+    clients[fd] = p;
+#endif
 }
 
 /* Removes client from the linked list and closes its socket.
- * Also removes socket descriptor from allset 
+ * Also removes socket descriptor from allset, or from the epoll set
+ * when its socket is closed.
  */
 void remove_player(struct client **top, int fd) {
     struct client **p;
@@ -102,8 +152,13 @@ void remove_player(struct client **top, int fd) {
     if (*p) {
         struct client *t = (*p)->next;
         printf("Removing client %d %s\n", fd, inet_ntoa((*p)->ipaddr));
+#ifdef USE_SELECT
         FD_CLR((*p)->fd, &allset);
+#else
+        clients[(*p)->fd] = NULL;
+#endif
         close((*p)->fd);
+        free((*p)->outbuf);
         free(*p);
         *p = t;
     } else {
@@ -113,51 +168,286 @@ void remove_player(struct client **top, int fd) {
 }
 
 
-int main(int argc, char **argv) {
-    struct sigaction sa;
-    sa.sa_handler = SIG_IGN;
-    sa.sa_flags = 0;
-    sigemptyset(&sa.sa_mask);
-    if (sigaction(SIGPIPE, &sa, NULL) == -1) {
-        perror("sigaction");
-        exit(1);
+/* Write as much of the len bytes of buf to fd as its socket takes now.
+ * Return the number of bytes written, or -1 if the client is gone.
+ */
+ssize_t write_some(int fd, const char *buf, size_t len) {
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n = write(fd, buf + done, len - done);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno != EPIPE && errno != ECONNRESET) {
+                perror("write");
+            }
+            return -1;
+        }
+        done += n;
     }
+    return done;
+}
 
-    int clientfd, maxfd, nready;
-    struct client *p;
 
-    fd_set rset;
+/* Write the len bytes of buf to the client on fd. Return 0 if they were
+ * sent or queued, and -1 if the client is gone.
+ * With epoll, client sockets are non-blocking, so what a socket cannot
+ * take now is queued behind the client's earlier output and sent when
+ * the socket is writable again. A client that lets more than MAX_PENDING
+ * bytes pile up is shut down, and then removed like any client that
+ * disconnects.
+ */
+int client_write(int fd, const char *buf, size_t len) {
+#ifdef USE_SELECT
+    return write_some(fd, buf, len) == (ssize_t) len ? 0 : -1;
+#else
+    struct client *p = fd < clients_cap ? clients[fd] : NULL;
+    ssize_t n = 0;
+
+    if (p == NULL) {
+        fprintf(stderr, "Trying to write to fd %d, but I don't know about it\n", fd);
+        return -1;
+    }
+    // output must go out in order, so only write now if none is queued
+    if (p->out_len == 0 && (n = write_some(fd, buf, len)) == -1) {
+        return -1;
+    }
+    if ((size_t) n == len) {
+        return 0;
+    }
+    if (p->out_len + len - n > MAX_PENDING) {
+        fprintf(stderr, "Client %d is not reading its output, dropping it\n", fd);
+        p->out_len = 0;
+        shutdown(fd, SHUT_RDWR);
+        return -1;
+    }
+    if (p->out_len + len - n > p->out_cap) {
+        int cap = p->out_cap ? p->out_cap : MAX_BUF;
+        while (cap < p->out_len + len - n) {
+            cap *= 2;
+        }
+        if ((p->outbuf = realloc(p->outbuf, cap)) == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+        p->out_cap = cap;
+    }
+    memcpy(p->outbuf + p->out_len, buf + n, len - n);
+    p->out_len += len - n;
+    return 0;
+#endif
+}
 
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <dictionary filename>\n", argv[0]);
-        exit(1);
+
+/* Read more input from client p into its inbuf, which holds at most
+ * size - 1 bytes. Return the number of bytes read, 0 if the client has
+ * disconnected or its socket failed, or -1 if its socket has nothing more
+ * to read for now.
+ */
+int read_input(struct client *p, int size) {
+    int nbytes;
+
+    while ((nbytes = read(p->fd, p->in_ptr, size - (p->in_ptr - p->inbuf + 1))) == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return -1;
+        }
+        // any other failure is the client's socket, not the server, so
+        // drop that client instead of exiting
+        if (errno != EINTR) {
+            if (errno != ECONNRESET) {
+                perror("read");
+            }
+            nbytes = 0;
+            break;
+        }
+    }
+    // the following is the partial reading part,
+    // we save what we've read in the client's inbuf
+    // and use in_ptr to point to the address.
+    if (nbytes != 0) {
+        p->in_ptr += nbytes;
+        *(p->in_ptr) = '\0';
     }
+    printf("[%d] Read %d bytes\n", p->fd, nbytes);
+    return nbytes;
+}
 
-    // Create and initialize the game state
-    struct game_state game;
 
-    srandom((unsigned int) time(NULL));
-    // Set up the file pointer outside of init_game because we want to 
-    // just rewind the file when we need to pick a new word
-    game.dict.fp = NULL;
-    game.dict.size = get_file_length(argv[1]);
+/* Handle input from the active player p. Return 1 if p may have more
+ * input to read, -1 if it has none for now, and 0 if p disconnected
+ * and has been removed.
+ */
+int read_player(struct game_state *game, struct client *p, int *disconnect, int *disconnect_len, int max_fd,
+                char *argvv) {
+    int nbytes = 1;
+    // haven't found a network newline, we keep on partial reading
+    if (strstr(p->inbuf, "\r\n") == NULL || p->in_ptr - strstr(p->inbuf, "\r\n") < 2) {
+        if ((nbytes = read_input(p, MAX_BUF)) == -1) {
+            return -1;
+        }
+    }
 
-    init_game(&game, argv[1]);
+    // if the client has disconnected
+    if (nbytes == 0) {
+        client_disconnect(game, disconnect, disconnect_len, max_fd, p->fd);
+        return 0;
+    }
 
-    // head and has_next_turn also don't change when a subsequent game is
-    // started so we initialize them here.
-    game.head = NULL;
-    game.has_next_turn = NULL;
+    // if we find the network newline
+    if (strstr(p->inbuf, "\r\n") != NULL) {
+
+        // a variable used if we need to pass the game
+        //to the next player
+        int next_turn = 0;
+        // array where we store the client input
+        char buf[MAX_BUF] = {'\0'};
+        // copy the user input from inbuf to buf
+        int i = 0;
+        while (i < MAX_BUF && i < p->in_ptr - p->inbuf) {
+            buf[i] = p->inbuf[i];
+            i++;
+        }
+        p->in_ptr = p->inbuf;
+        // change the inbuf to an empty array,
+        //convenient for next read
+        i = 0;
+        while (i < MAX_BUF) {
+            p->inbuf[i] = '\0';
+            i++;
+        }
+        // change buf to a string
+        *strstr(buf, "\r\n") = '\0';
+        printf("[%d] Found newline %s\n", p->fd, buf);
+
+        //if it's not this client's turn
+        if (game->has_next_turn->fd != p->fd) {
+            printf("Player %s tried to guess out of turn\n", p->name);
+            client_write(p->fd, "It is not your turn to guess.\r\n",
+                  strlen("It is not your turn to guess.\r\n"));
+        } else {
+            // if the client input more than one character
+            if (strlen(buf) != 1) {
+                client_write(p->fd, "invalid guess.\r\n", strlen("invalid guess.\r\n"));
+            } else {
+                guess_length_right(game, disconnect, disconnect_len, max_fd, &next_turn,
+                                   buf, p->fd);
+            }
 
-    /* A list of client who have not yet entered their name.  This list is
-     * kept separate from the list of active players in the game, because
-     * until the new playrs have entered a name, they should not have a turn
-     * or receive broadcast messages.  In other words, they can't play until
-     * they have a name.
-     */
-    struct client *new_players = NULL;
+            won_lose(game, disconnect, disconnect_len, max_fd, argvv, p->fd);
+        }
+    }
+    return 1;
+}
+
+
+/* Handle input from p, a client in new_players who has not entered an
+ * acceptable name. Once it has, p moves to the game. Return 1 if p may
+ * have more input to read, -1 if it has none for now, and 0 if p
+ * disconnected and has been removed.
+ */
+int read_new_player(struct game_state *game, struct client **new_players, struct client *p, int *disconnect,
+                    int *disconnect_len, int max_fd) {
+    // haven't found a network newline, we keep on partial reading
+    int nbytes = 1;
+    if (strstr(p->inbuf, "\r\n") == NULL || p->in_ptr - strstr(p->inbuf, "\r\n") < 2) {
+        if ((nbytes = read_input(p, MAX_NAME)) == -1) {
+            return -1;
+        }
+    }
+
+    // if the client has disconnected
+    if (nbytes == 0) {
+        remove_player(new_players, p->fd);
+        return 0;
+    }
+
+    // if we find the network newline
+    if (strstr(p->inbuf, "\r\n") != NULL) {
+        // array where we store the client input
+        char buf[MAX_NAME] = {'\0'};
+        // copy the user input from inbuf to buf
+        int i = 0;
+        while (i < MAX_NAME && i < p->in_ptr - p->inbuf) {
+            buf[i] = p->inbuf[i];
+            i++;
+        }
+
+        p->in_ptr = p->inbuf;
+        // change the inbuf to an empty array,
+        //convenient for next read
+        i = 0;
+        while (i < MAX_BUF) {
+            p->inbuf[i] = '\0';
+            i++;
+        }
+
+        // change buf to a string
+        *strstr(buf, "\r\n") = '\0';
+        printf("[%d] Found newline %s\n", p->fd, buf);
+
+        // find if the name already exists
+        int flag = 1;
+        for (struct client *k = game->head; k != NULL; k = k->next) {
+            if (strcmp(k->name, buf) == 0) {
+                flag = 0;
+            }
+        }
+
+        // name already exists
+        if (flag == 0) {
+            client_write(p->fd, "invalid name, please write again\r\n",
+                  strlen("invalid name, please write again\r\n"));
+        } else {
+            // the client input an invalid name
+            printf("%s has just joined.\n", buf);
+            strcpy(p->name, buf);
+
+            // add the client to the game and delete it from the new_players
+            struct client *current = *new_players;
+            struct client *previous = current;
+            while (current != NULL && current->fd != p->fd) {
+                previous = current;
+                current = current->next;
+            }
+            if (previous == current) {
+                previous = p->next;
+                *new_players = p->next;
+            } else {
+                previous->next = p->next;
+            }
+            p->next = game->head;
+            p->in_game = 1;
+            game->head = p;
+
+            // if the player is the first player in the game
+            if (game->head->next == NULL) {
+                game->has_next_turn = game->head;
+            }
+
+            broadcast_first_join(game, disconnect, disconnect_len, max_fd, buf);
+
+        }
+    }
+    return 1;
+}
+
+
+#ifdef USE_SELECT
+
+/* Serve the game with select, which looks at every socket descriptor
+ * on each wakeup and so suits a few players.
+ */
+void serve(struct game_state *game, struct client **new_players, struct sockaddr_in *server, char *argvv) {
+    int clientfd, maxfd, nready;
+    struct client *p;
+
+    fd_set rset;
 
-    struct sockaddr_in *server = init_server_addr(PORT);
     int listenfd = set_up_server_socket(server, MAX_QUEUE);
 
     // initialize allset and add listenfd to the
@@ -185,11 +475,11 @@ int main(int argc, char **argv) {
                 maxfd = clientfd;
             }
             printf("Connection from %s\n", inet_ntoa(server->sin_addr));
-            add_player(&new_players, clientfd, server->sin_addr);
+            add_player(new_players, clientfd, server->sin_addr);
             char *greeting = WELCOME_MSG;
-            if (write(clientfd, greeting, strlen(greeting)) == -1) {
+            if (client_write(clientfd, greeting, strlen(greeting)) == -1) {
                 fprintf(stderr, "Write to client %s failed\n", inet_ntoa(server->sin_addr));
-                remove_player(&new_players, clientfd);
+                remove_player(new_players, clientfd);
             };
         }
 
@@ -198,7 +488,7 @@ int main(int argc, char **argv) {
          * search through the two lists of clients each time is that it is
          * possible that a client will be removed in the middle of one of the
          * operations. This is also why we call break after handling the input.
-         * If a client has been removed the loop variables may not longer be 
+         * If a client has been removed the loop variables may not longer be
          * valid.
          */
 
@@ -207,7 +497,7 @@ int main(int argc, char **argv) {
         //this will reduce the pressure of the computer, I supposed.
         int max_fd = maxfd + 1;
         int disconnect[max_fd];
-        // set all the element of this array to be -1, 
+        // set all the element of this array to be -1,
         //since all the fd of the player is non-negative
         for (int y = 0; y < max_fd; y++) {
             disconnect[y] = -1;
@@ -219,196 +509,255 @@ int main(int argc, char **argv) {
         for (cur_fd = 0; cur_fd <= maxfd; cur_fd++) {
             if (FD_ISSET(cur_fd, &rset)) {
                 // Check if this socket descriptor is an active player
-
-                for (p = game.head; p != NULL; p = p->next) {
+                for (p = game->head; p != NULL; p = p->next) {
                     if (cur_fd == p->fd) {
-                        // handle input from an active client
-                        int nbytes;
-                        // haven't found a network newline, we keep on partial reading
-                        if (strstr(p->inbuf, "\r\n") == NULL || p->in_ptr - strstr(p->inbuf, "\r\n") < 2) {
-                            nbytes = read(p->fd, p->in_ptr, MAX_BUF - (p->in_ptr - p->inbuf + 1));
-                            if (nbytes == -1) {
-                                perror("read");
-                                exit(1);
-                            }
-                            if (nbytes != 0) {
-                                // the following is the partial reading part,
-                                // we save what we've read in the client's inbuf
-                                // and use in_ptr to point to the address.
-                                p->in_ptr += nbytes;
-                                *(p->in_ptr) = '\0';
-                                printf("[%d] Read %d bytes\n", p->fd, nbytes);
-                            } else {
-                                printf("[%d] Read 0 bytes\n", p->fd);
-                            }
-                        }
-
-                        // if the client hasn't disconnect
-                        if (nbytes != 0) {
-                            // if we find the network newline
-                            if (strstr(p->inbuf, "\r\n") != NULL) {
-
-                                // a variable used if we need to pass the game 
-                                //to the next player
-                                int next_turn = 0;
-                                // array where we store the client input
-                                char buf[MAX_BUF] = {'\0'};
-                                // copy the user input from inbuf to buf
-                                int i = 0;
-                                while (i < MAX_BUF && i < p->in_ptr - p->inbuf) {
-                                    buf[i] = p->inbuf[i];
-                                    i++;
-                                }
-                                p->in_ptr = p->inbuf;
-                                // change the inbuf to an empty array, 
-                                //convenient for next read
-                                i = 0;
-                                while (i < MAX_BUF) {
-                                    p->inbuf[i] = '\0';
-                                    i++;
-                                }
-                                // change buf to a string
-                                *strstr(buf, "\r\n") = '\0';
-                                printf("[%d] Found newline %s\n", p->fd, buf);
-
-                                //if it's not this client's turn
-                                if (game.has_next_turn->fd != p->fd) {
-                                    printf("Player %s tried to guess out of turn\n", p->name);
-                                    write(p->fd, "It is not your turn to guess.\r\n",
-                                          strlen("It is not your turn to guess.\r\n"));
-                                } else {
-                                    // if the client input more than one character
-                                    if (strlen(buf) != 1) {
-                                        write(p->fd, "invalid guess.\r\n", strlen("invalid guess.\r\n"));
-                                    } else {
-                                        guess_length_right(&game, disconnect, &disconnect_len, max_fd, &next_turn,
-                                                           buf, p->fd);
-                                    }
-
-                                    won_lose(&game, disconnect, &disconnect_len, max_fd, argv[1], p->fd);
-                                }
-                            }
-
-                        } else {
-                            client_disconnect(&game, disconnect, &disconnect_len, max_fd, p->fd);
-                        }
+                        read_player(game, p, disconnect, &disconnect_len, max_fd, argvv);
                         break;
                     }
                 }
 
                 // Check if any new players are entering their names
-                for (p = new_players; p != NULL; p = p->next) {
+                for (p = *new_players; p != NULL; p = p->next) {
                     if (cur_fd == p->fd) {
-                        // handle input from an new client who has
-                        // not entered an acceptable name.
-
-                        // haven't found a network newline, we keep on partial reading
-                        int nbytes = 1;
-                        if (strstr(p->inbuf, "\r\n") == NULL || p->in_ptr - strstr(p->inbuf, "\r\n") < 2) {
-                            nbytes = read(p->fd, p->in_ptr, MAX_NAME - (p->in_ptr - p->inbuf + 1));
-                            if (nbytes == -1) {
-                                perror("read");
-                                exit(1);
-                            }
-                            // the following is the partial reading part,
-                            // we save what we've read in the client's inbuf
-                            // and use in_ptr to point to the address.
-                            if (nbytes != 0) {
-                                p->in_ptr += nbytes;
-                                *(p->in_ptr) = '\0';
-                                printf("[%d] Read %d bytes\n", p->fd, nbytes);
-                            } else {
-                                printf("[%d] Read 0 bytes\n", p->fd);
-                            }
-                        }
-
-                        // if the client hasn't disconnect
-                        if (nbytes != 0) {
-                            // if we find the network newline
-                            if (strstr(p->inbuf, "\r\n") != NULL) {
-                                // array where we store the client input
-                                char buf[MAX_NAME] = {'\0'};
-                                // copy the user input from inbuf to buf
-                                int i = 0;
-                                while (i < MAX_NAME && i < p->in_ptr - p->inbuf) {
-                                    buf[i] = p->inbuf[i];
-                                    i++;
-                                }
-
-                                p->in_ptr = p->inbuf;
-                                // change the inbuf to an empty array, 
-                                //convenient for next read
-                                i = 0;
-                                while (i < MAX_BUF) {
-                                    p->inbuf[i] = '\0';
-                                    i++;
-                                }
-
-                                // change buf to a string
-                                *strstr(buf, "\r\n") = '\0';
-                                printf("[%d] Found newline %s\n", p->fd, buf);
-
-                                // find if the name already exists
-                                int flag = 1;
-                                for (struct client *k = game.head; k != NULL; k = k->next) {
-                                    if (strcmp(k->name, buf) == 0) {
-                                        flag = 0;
-                                    }
-                                }
-
-                                // name already exists
-                                if (flag == 0) {
-                                    write(p->fd, "invalid name, please write again\r\n",
-                                          strlen("invalid name, please write again\r\n"));
-                                } else {
-                                    // the client input an invalid name
-                                    printf("%s has just joined.\n", buf);
-                                    strcpy(p->name, buf);
-
-                                    // add the client to the game and delete it from the new_players
-                                    struct client *current = new_players;
-                                    struct client *previous = current;
-                                    while (current != NULL && current->fd != p->fd) {
-                                        previous = current;
-                                        current = current->next;
-                                    }
-                                    if (previous == current) {
-                                        previous = p->next;
-                                        new_players = p->next;
-                                    } else {
-                                        previous->next = p->next;
-                                    }
-                                    p->next = game.head;
-                                    game.head = p;
-
-                                    // if the player is the first player in the game
-                                    if (game.head->next == NULL) {
-                                        game.has_next_turn = game.head;
-                                    }
-
-                                    broadcast_first_join(&game, disconnect, &disconnect_len, max_fd, buf);
-
-                                }
-                            }
-
-                        } else {
-                            remove_player(&new_players, p->fd);
-                        }
-
+                        read_new_player(game, new_players, p, disconnect, &disconnect_len, max_fd);
                         break;
                     }
                 }
             }
         }
     }
+}
+
+#else
+
+/* Raise the limit on open files as far as allowed, so that the server
+ * can hold as many players as the system lets it.
+ */
+void raise_fd_limit(void) {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1) {
+        perror("getrlimit");
+        return;
+    }
+    limit.rlim_cur = limit.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &limit) == -1) {
+        perror("setrlimit");
+    }
+}
+
+/* A descriptor kept open to be given up when the server runs out of
+ * them, so that a waiting connection can still be accepted and closed.
+ */
+int spare_fd = -1;
+
+/* Send what the socket of p takes of the output queued for it. */
+void flush_output(struct client *p) {
+    ssize_t n = write_some(p->fd, p->outbuf, p->out_len);
+
+    if (n == -1) {
+        // the client is gone; reading its socket will remove it
+        p->out_len = 0;
+        return;
+    }
+    memmove(p->outbuf, p->outbuf + n, p->out_len - n);
+    p->out_len -= n;
+}
+
+/* Accept every connection waiting on listenfd, add each to new_players
+ * and to the epoll set epfd, and greet it. Return the largest socket
+ * descriptor accepted, or -1 if there was none.
+ */
+int accept_players(int epfd, int listenfd, struct client **new_players) {
+    struct sockaddr_in peer;
+    struct epoll_event ev;
+    int clientfd, maxfd = -1;
+
+    // edge-triggered, so take everything now: no wakeup comes for the rest
+    while (1) {
+        if ((clientfd = accept_nonblocking(listenfd, &peer)) == -1) {
+            if ((errno != EMFILE && errno != ENFILE) || spare_fd == -1) {
+                break;
+            }
+            // out of descriptors: turn the client away with the spare one,
+            // or it would wait for a wakeup that may never come
+            close(spare_fd);
+            clientfd = accept(listenfd, NULL, NULL);
+            if (clientfd != -1) {
+                fprintf(stderr, "Out of file descriptors, turning a client away\n");
+                close(clientfd);
+            }
+            spare_fd = open("/dev/null", O_RDONLY);
+            if (clientfd == -1) {
+                break;
+            }
+            continue;
+        }
+        printf("Connection from %s\n", inet_ntoa(peer.sin_addr));
+        add_player(new_players, clientfd, peer.sin_addr);
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = *new_players;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, clientfd, &ev) == -1) {
+            perror("epoll_ctl");
+            exit(1);
+        }
+        if (clientfd > maxfd) {
+            maxfd = clientfd;
+        }
+        char *greeting = WELCOME_MSG;
+        if (client_write(clientfd, greeting, strlen(greeting)) == -1) {
+            fprintf(stderr, "Write to client %s failed\n", inet_ntoa(peer.sin_addr));
+            remove_player(new_players, clientfd);
+        }
+    }
+    return maxfd;
+}
+
+/* Serve the game with edge-triggered epoll. Each event carries its client,
+ * so handling it costs the same however many players are connected.
+ */
+void serve(struct game_state *game, struct client **new_players, struct sockaddr_in *server, char *argvv) {
+    struct epoll_event ev, events[MAX_EVENTS];
+
+    raise_fd_limit();
+    if ((spare_fd = open("/dev/null", O_RDONLY)) == -1) {
+        perror("open");
+        exit(1);
+    }
+    int listenfd = set_up_server_socket(server, SOMAXCONN);
+    set_nonblocking(listenfd);
+    int epfd = epoll_create1(0);
+    if (epfd == -1) {
+        perror("epoll_create1");
+        exit(1);
+    }
+    // the listening socket is the one event without a client
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &ev) == -1) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+    int maxfd = listenfd;
+
+    // the players whose writes failed in this batch of events, as with
+    // select, but kept between batches and reset only where it was used
+    int disconnect_cap = 0, disconnect_len = 0;
+    int *disconnect = NULL;
+
+    while (1) {
+        if (maxfd + 1 > disconnect_cap) {
+            int cap = disconnect_cap ? disconnect_cap : 64;
+            while (cap < maxfd + 1) {
+                cap *= 2;
+            }
+            if ((disconnect = realloc(disconnect, cap * sizeof(int))) == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+            for (int y = disconnect_cap; y < cap; y++) {
+                disconnect[y] = -1;
+            }
+            disconnect_cap = cap;
+        }
+
+        int nready = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (nready == -1) {
+            if (errno != EINTR) {
+                perror("epoll_wait");
+            }
+            continue;
+        }
+
+        for (int i = 0; i < nready; i++) {
+            struct client *p = events[i].data.ptr;
+            if (p == NULL) {
+                int fd = accept_players(epfd, listenfd, new_players);
+                if (fd > maxfd) {
+                    maxfd = fd;
+                }
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) && p->out_len > 0) {
+                flush_output(p);
+            }
+            if (!(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+                continue;
+            }
+            // read until the socket is drained or the client is gone; a
+            // client is only ever removed while its own event is handled
+            int status;
+            do {
+                if (p->in_game) {
+                    status = read_player(game, p, disconnect, &disconnect_len, disconnect_cap, argvv);
+                } else {
+                    status = read_new_player(game, new_players, p, disconnect, &disconnect_len,
+                                             disconnect_cap);
+                }
+            } while (status == 1);
+        }
+
+        for (int y = 0; y < disconnect_len; y++) {
+            disconnect[y] = -1;
+        }
+        disconnect_len = 0;
+    }
+}
+
+#endif
+
+
+int main(int argc, char **argv) {
+    struct sigaction sa;
+    sa.sa_handler = SIG_IGN;
+    sa.sa_flags = 0;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPIPE, &sa, NULL) == -1) {
+        perror("sigaction");
+        exit(1);
+    }
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <dictionary filename>\n", argv[0]);
+        exit(1);
+    }
+
+    // Create and initialize the game state
+    struct game_state game;
+
+    srandom((unsigned int) time(NULL));
+    // Set up the file pointer outside of init_game because we want to
+    // just rewind the file when we need to pick a new word
+    game.dict.fp = NULL;
+    game.dict.size = get_file_length(argv[1]);
+
+    init_game(&game, argv[1]);
+
+    // head and has_next_turn also don't change when a subsequent game is
+    // started so we initialize them here.
+    game.head = NULL;
+    game.has_next_turn = NULL;
+
+    /* A list of client who have not yet entered their name.  This list is
+     * kept separate from the list of active players in the game, because
+     * until the new playrs have entered a name, they should not have a turn
+     * or receive broadcast messages.  In other words, they can't play until
+     * they have a name.
+     */
+    struct client *new_players = NULL;
+
+    struct sockaddr_in *server = init_server_addr(PORT);
+    serve(&game, &new_players, server, argv[1]);
     return 0;
 }
 
 
-/* distinguish whether a client with fd be fd in the disconnect array*/
+
+/* distinguish whether a client with fd be fd in the disconnect array,
+ * which is filled from the front, so we stop at the first unused -1*/
 int in_array(int *disconnect, int fd, int max_fd) {
     int i;
-    for (i = 0; i < max_fd; i++) {
+    for (i = 0; i < max_fd && disconnect[i] != -1; i++) {
         if (disconnect[i] == fd) {
             return 1;
         }
@@ -424,7 +773,7 @@ void broadcast(struct game_state *game, char *outbuf, int *disconnect, int *disc
         // if the client disconnect during this iteration,
         // we don't broadcast to it
         if (in_array(disconnect, p->fd, max_fd) == 0) {
-            if (write(p->fd, outbuf, strlen(outbuf)) == -1) {
+            if (client_write(p->fd, outbuf, strlen(outbuf)) == -1) {
                 // if the client disconnect during broadcast
                 // we add it do this list and don't write to it anymore
                 disconnect[*disconnect_len] = p->fd;
@@ -450,12 +799,12 @@ void announce_turn(struct game_state *game, int *disconnect, int *disconnect_len
                 strcpy(announce, "It's ");
                 strncat(announce, game->has_next_turn->name, sizeof(announce) - strlen(game->has_next_turn->name) - 1);
                 strncat(announce, "'s turn.\r\n", sizeof(announce) - strlen("'s turn.\r\n") - 1);
-                if (write(p->fd, announce, strlen(announce)) == -1) {
+                if (client_write(p->fd, announce, strlen(announce)) == -1) {
                     disconnect[*disconnect_len] = p->fd;
                     *disconnect_len = *disconnect_len + 1;
                 }
             } else {
-                if (write(p->fd, "Your guess?\r\n", strlen("Your guess?\r\n")) == -1) {
+                if (client_write(p->fd, "Your guess?\r\n", strlen("Your guess?\r\n")) == -1) {
                     disconnect[*disconnect_len] = p->fd;
                     *disconnect_len = *disconnect_len + 1;
 
@@ -476,7 +825,7 @@ void announce_winner(struct game_state *game, struct client *winner, int *discon
             strcpy(announce1, "The word was ");
             strncat(announce1, game->word, sizeof(announce1) - strlen(game->word) - 1);
             strncat(announce1, ".\r\n", sizeof(announce1) - strlen(".\r\n") - 1);
-            if (write(p->fd, announce1, strlen(announce1)) == -1) {
+            if (client_write(p->fd, announce1, strlen(announce1)) == -1) {
                 disconnect[*disconnect_len] = p->fd;
                 *disconnect_len = *disconnect_len + 1;
             }
@@ -487,12 +836,12 @@ void announce_winner(struct game_state *game, struct client *winner, int *discon
                 strcpy(announce, "Game over! ");
                 strncat(announce, winner->name, sizeof(announce) - strlen(winner->name) - 1);
                 strncat(announce, " won!\n\r\n", sizeof(announce) - strlen(" won!\r\n") - 1);
-                if (write(p->fd, announce, strlen(announce)) == -1) {
+                if (client_write(p->fd, announce, strlen(announce)) == -1) {
                     disconnect[*disconnect_len] = p->fd;
                     *disconnect_len = *disconnect_len + 1;
                 }
             } else {
-                if (write(p->fd, "Game over! You win!\n\r\n", strlen("Game over! You win!\n\r\n")) == -1) {
+                if (client_write(p->fd, "Game over! You win!\n\r\n", strlen("Game over! You win!\n\r\n")) == -1) {
                     disconnect[*disconnect_len] = p->fd;
                     *disconnect_len = *disconnect_len + 1;
                 }
@@ -625,7 +974,7 @@ void guess_not_in(struct game_state *game, int *disconnect, int *disconnect_len,
     strcpy(message, buf);
     strncat(message, " is not in the word\r\n",
             sizeof(message) - strlen(" is not in the word\r\n") - 1);
-    if (write(pfd, message, strlen(message)) == -1) {
+    if (client_write(pfd, message, strlen(message)) == -1) {
         disconnect[*disconnect_len] = pfd;
         *disconnect_len = *disconnect_len + 1;
     }
@@ -666,7 +1015,7 @@ void broadcast_first_join(struct game_state *game, int *disconnect, int *disconn
         exit(1);
     }
     msg = status_message(msg, game);
-    write(game->head->fd, msg, strlen(msg));
+    client_write(game->head->fd, msg, strlen(msg));
     free(msg);
     announce_turn(game, disconnect, disconnect_len, max_fd);
 }
@@ -689,7 +1038,7 @@ void guess_length_right(struct game_state *game, int *disconnect, int *disconnec
         k = guess - 'a';
         // if the letter has been guessed
         if (game->letters_guessed[k]) {
-            write(pfd, "invalid guess.\r\n",
+            client_write(pfd, "invalid guess.\r\n",
                   strlen("invalid guess.\r\n"));
         } else {
             // if the letter has never been guessed
@@ -718,6 +1067,6 @@ void guess_length_right(struct game_state *game, int *disconnect, int *disconnec
 
     } else {
         // although the client guessed one character, it is not a-z
-        write(pfd, "invalid guess.\r\n", strlen("invalid guess.\r\n"));
+        client_write(pfd, "invalid guess.\r\n", strlen("invalid guess.\r\n"));
     }
 }